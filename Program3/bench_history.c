@@ -0,0 +1,162 @@
+/* **********************************************************************************
+ ** Program Name:   Program 3 - smallsh (bench_history.c)
+ ** Author:         Susan Hibbert
+ ** Date:           20th May 2020
+ ** Description:    Benchmark for the smallsh history. For each history size it
+		    writes a history log and index with that many entries, then times
+		    how long the shell takes to start and exit with that history, and
+		    how long a session of !prefix searches takes (the first search
+		    builds the search index). Startup should take the same time
+		    whatever the size of the history. The shell's own output is thrown
+		    away.
+
+		    USAGE: bench_history [shell] [searches]
+		    (default: ./smallsh, 1000 searches)
+ ** *******************************************************************************/
+
+#define _GNU_SOURCE		// posix_openpt, grantpt, unlockpt and ptsname
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <time.h>
+#include <termios.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define HISTORY_NAME "bench_history.log"
+#define STARTUP_RUNS 20
+
+// Returns the time in seconds from a monotonic clock
+double now()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+
+/* **********************************************************************************
+ ** Description: Writes a history with the given number of entries. Each entry is a
+		 comment (#c followed by its number), so running it does nothing
+ ** Input(s): 	 Number of entries
+ ** Output(s): 	 Exits with an error message if the history cannot be written
+ ** Returns: 	 No return value
+ ** *******************************************************************************/
+void writeHistory(int entries)
+{
+	FILE* log = fopen(HISTORY_NAME, "w");
+	FILE* index = fopen(HISTORY_NAME ".idx", "w");
+	uint64_t offset = 0;
+	int i;
+
+	if (log == NULL || index == NULL)
+	{
+		perror("Error writing " HISTORY_NAME);
+		exit(1);
+	}
+	for (i = 0; i < entries; i++)
+	{
+		fwrite(&offset, sizeof(offset), 1, index);
+		offset += fprintf(log, "#c%07d comment\n", i);
+	}
+	fclose(log);
+	fclose(index);
+}
+
+
+/* **********************************************************************************
+ ** Description: Runs the shell at the prompt with the given input, followed by an end
+		 of file. The shell only keeps its history when the prompt is on a
+		 terminal, so it is run on a pseudo-terminal, as the leader of a
+		 session of its own, with echo turned off
+ ** Input(s): 	 The shell and its input
+ ** Output(s): 	 Exits with an error message if the shell cannot be started
+ ** Returns: 	 The time taken in seconds
+ ** *******************************************************************************/
+double runShell(const char* shell, const char* input)
+{
+	double start = now();
+	struct termios modes;
+
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (master == -1 || grantpt(master) == -1 || unlockpt(master) == -1)
+	{
+		perror("Error creating pseudo-terminal");
+		exit(1);
+	}
+	tcgetattr(master, &modes);
+	modes.c_lflag &= ~ECHO;
+	tcsetattr(master, TCSANOW, &modes);
+
+	pid_t spawnPid = fork();
+	if (spawnPid == -1)
+	{
+		perror("Error spawning shell");
+		exit(1);
+	}
+	else if (spawnPid == 0)
+	{
+		setsid();
+		int slave = open(ptsname(master), O_RDWR);
+		int devNull = open("/dev/null", O_WRONLY);
+		dup2(slave, 0);
+		dup2(devNull, 1);
+		dup2(devNull, 2);
+		close(master);
+		setenv("HISTFILE", HISTORY_NAME, 1);
+		execl(shell, shell, NULL);
+		exit(127);
+	}
+
+	// ^D at the start of a line is the end of the input
+	write(master, input, strlen(input));
+	write(master, "\x04", 1);
+	waitpid(spawnPid, NULL, 0);
+	close(master);
+	return now() - start;
+}
+
+
+int main(int argc, char* argv[])
+{
+	const char* shell = argc > 1 ? argv[1] : "./smallsh";
+	int searches = argc > 2 ? atoi(argv[2]) : 1000;
+	int sizes[] = { 0, 1000, 100000, 1000000 };
+	int i, j;
+
+	// the search session asks for entries spread through the history
+	char* session = malloc(searches * 16 + 1);
+	char* end = session;
+	*end = '\0';
+
+	for (i = 0; i < 4; i++)
+	{
+		end = session;
+		for (j = 0; j < searches && sizes[i] > 0; j++)
+		{
+			end += sprintf(end, "!#c%07d\n", (int)((long)j * 7919 % sizes[i]));
+		}
+		*end = '\0';
+
+		// an empty session adds nothing to the history
+		double startup = 0;
+		writeHistory(sizes[i]);
+		for (j = 0; j < STARTUP_RUNS; j++)
+		{
+			startup += runShell(shell, "");
+		}
+		double search = runShell(shell, session);
+
+		printf("%8d entries: startup %.2f ms, %d searches %.2f ms\n", sizes[i],
+		       startup / STARTUP_RUNS * 1000, sizes[i] > 0 ? searches : 0, search * 1000);
+		fflush(stdout);
+	}
+
+	unlink(HISTORY_NAME);
+	unlink(HISTORY_NAME ".idx");
+	free(session);
+	return 0;
+}
@@ -0,0 +1,105 @@
+/* **********************************************************************************
+ ** Program Name:   Program 3 - smallsh (bench_launch.c)
+ ** Author:         Susan Hibbert
+ ** Date:           20th May 2020
+ ** Description:    Benchmark for starting commands from smallsh. It feeds a shell a
+		    tight loop of `/bin/true` commands on its standard input and reports
+		    how many commands per second the shell ran. The full path is used
+		    because true is a built-in command, which starts no process. Any
+		    shell which reads commands from standard input can be measured for
+		    comparison (e.g. /bin/dash). The shell's own output is thrown away,
+		    and any history it keeps goes to files of its own, which are
+		    removed afterwards.
+
+		    USAGE: bench_launch [commands] [command] [shell] [shell arguments...]
+		    (default: 10000 /bin/true commands with ./smallsh)
+ ** *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define HISTORY_NAME "bench_launch.history"
+
+// Returns the time in seconds from a monotonic clock
+double now()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+
+int main(int argc, char* argv[])
+{
+	int commands = argc > 1 ? atoi(argv[1]) : 10000;
+	char* defaultShell[] = { "./smallsh", NULL };
+	char** shell = argc > 3 ? &argv[3] : defaultShell;
+	char line[256];
+	int pipeFDs[2];
+	int i;
+
+	if (commands < 1) { fprintf(stderr, "USAGE: %s [commands] [command] [shell] [shell arguments...]\n", argv[0]); exit(1); }
+	int lineLength = snprintf(line, sizeof(line), "%s\n", argc > 2 ? argv[2] : "/bin/true");
+	size_t scriptLength = (size_t)commands * lineLength;
+
+	// write the whole script up front, so the shell never waits for its input
+	char* script = malloc(scriptLength);
+	for (i = 0; i < commands; i++)
+	{
+		memcpy(script + (size_t)i * lineLength, line, lineLength);
+	}
+
+	if (pipe(pipeFDs) == -1)
+	{
+		perror("Error creating pipe");
+		exit(1);
+	}
+
+	double start = now();
+	pid_t spawnPid = fork();
+	if (spawnPid == -1)
+	{
+		perror("Error spawning shell");
+		exit(1);
+	}
+	else if (spawnPid == 0)
+	{
+		int devNull = open("/dev/null", O_WRONLY);
+		dup2(pipeFDs[0], 0);
+		dup2(devNull, 1);
+		close(pipeFDs[0]);
+		close(pipeFDs[1]);
+		setenv("HISTFILE", HISTORY_NAME, 1);
+		execvp(shell[0], shell);
+		perror("Error running shell");
+		exit(1);
+	}
+
+	// the shell exits when it reaches the end of its input
+	close(pipeFDs[0]);
+	size_t written = 0;
+	while (written < scriptLength)
+	{
+		ssize_t n = write(pipeFDs[1], script + written, scriptLength - written);
+		if (n <= 0)
+		{
+			perror("Error writing to shell");
+			break;
+		}
+		written += n;
+	}
+	close(pipeFDs[1]);
+	waitpid(spawnPid, NULL, 0);
+
+	double elapsed = now() - start;
+	unlink(HISTORY_NAME);
+	unlink(HISTORY_NAME ".idx");
+	printf("%s: %d commands in %.3f seconds (%.0f commands/second)\n", shell[0], commands, elapsed, commands / elapsed);
+	return 0;
+}
@@ -0,0 +1,345 @@
+/* **********************************************************************************
+ ** Program Name:   Program 3 - smallsh (bench_pty.c)
+ ** Author:         Susan Hibbert
+ ** Date:           20th May 2020
+ ** Description:    Latency benchmark for smallsh. It runs the shell on a pseudo-
+		    terminal, as a user would, typing each command and waiting for
+		    the next ':' prompt, and measures:
+
+		    - cold start: from starting the shell to its first prompt
+		    - prompt-to-prompt latency of a built-in command (true) and of an
+		      external one (/bin/true), and the difference between them, which
+		      is what starting a process costs
+		    - background reaping: from a background job exiting to the shell
+		      reaping it, while it sits at the prompt
+		    - pipeline throughput: MB/s through cat | cat | cat
+
+		    The results are written to standard output as JSON, so they can
+		    be kept for each commit and compared. Times are in microseconds,
+		    except the cold start, which is in milliseconds. The shell keeps
+		    its history in files of its own, which are removed afterwards.
+
+		    USAGE: bench_pty [iterations] [shell] [shell arguments...]
+		    (default: 500 iterations with ./smallsh)
+ ** *******************************************************************************/
+
+#define _GNU_SOURCE		// posix_openpt, grantpt, unlockpt and ptsname
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <termios.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+
+#define HISTORY_NAME "bench_pty.history"
+#define PROMPT_TIMEOUT 10000		// milliseconds to wait for a prompt before giving up
+#define PIPELINE_BYTES (64 << 20)	// bytes sent through the pipeline
+#define PIPELINE_RUNS 5			// the best of this many pipeline runs is kept
+
+// a shell running on a pseudo-terminal
+struct shell
+{
+	pid_t pid;
+	int master;			// our end of the pseudo-terminal
+	char output[4096];		// what the shell wrote after the last command, up to the prompt
+	size_t length;
+};
+
+
+// Returns the time in seconds from a monotonic clock
+double now()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+
+/* **********************************************************************************
+ ** Description: Reads what the shell writes until it prompts for the next command -
+		 that is, until its output stops at a ':'. The commands run by the
+		 benchmark never end their own output with one
+ ** Input(s): 	 The shell
+ ** Output(s): 	 Exits with an error message if the shell does not prompt in time
+ ** Returns: 	 No return value
+ ** *******************************************************************************/
+void waitPrompt(struct shell* shell)
+{
+	struct pollfd ready = { shell->master, POLLIN, 0 };
+	shell->length = 0;
+
+	while (1)
+	{
+		if (poll(&ready, 1, PROMPT_TIMEOUT) <= 0)
+		{
+			fprintf(stderr, "No prompt from the shell after %d seconds\n", PROMPT_TIMEOUT / 1000);
+			exit(1);
+		}
+
+		// keep the end of the output, which holds the prompt and any messages before it
+		if (shell->length > sizeof(shell->output) / 2)
+		{
+			memmove(shell->output, shell->output + shell->length / 2, shell->length - shell->length / 2);
+			shell->length -= shell->length / 2;
+		}
+		ssize_t n = read(shell->master, shell->output + shell->length, sizeof(shell->output) - shell->length - 1);
+		if (n <= 0)
+		{
+			fprintf(stderr, "The shell exited\n");
+			exit(1);
+		}
+		shell->length += n;
+		shell->output[shell->length] = '\0';
+		if (shell->output[shell->length - 1] == ':')
+		{
+			return;
+		}
+	}
+}
+
+
+/* **********************************************************************************
+ ** Description: Starts the shell on a new pseudo-terminal, as the session leader
+		 with the terminal as its controlling terminal, and waits for its
+		 first prompt. Echo is turned off, so only the shell's own output is
+		 read back
+ ** Input(s): 	 The shell to fill in, and the command to run it
+ ** Output(s): 	 Exits with an error message if the shell cannot be started
+ ** Returns: 	 The seconds from starting the shell to its first prompt
+ ** *******************************************************************************/
+double startShell(struct shell* shell, char** command)
+{
+	double start = now();
+	shell->master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+	if (shell->master == -1 || grantpt(shell->master) == -1 || unlockpt(shell->master) == -1)
+	{
+		perror("Error creating pseudo-terminal");
+		exit(1);
+	}
+
+	shell->pid = fork();
+	if (shell->pid == -1)
+	{
+		perror("Error spawning shell");
+		exit(1);
+	}
+	else if (shell->pid == 0)
+	{
+		setsid();
+		int slave = open(ptsname(shell->master), O_RDWR);
+		if (slave == -1)
+		{
+			perror("Error opening pseudo-terminal");
+			exit(1);
+		}
+		struct termios modes;
+		tcgetattr(slave, &modes);
+		modes.c_lflag &= ~ECHO;
+		tcsetattr(slave, TCSANOW, &modes);
+		dup2(slave, 0);
+		dup2(slave, 1);
+		dup2(slave, 2);
+		if (slave > 2) close(slave);
+		execvp(command[0], command);
+		perror("Error running shell");
+		exit(1);
+	}
+
+	waitPrompt(shell);
+	return now() - start;
+}
+
+
+// Types a command and waits for the next prompt. Returns the seconds it took
+double runCommand(struct shell* shell, const char* command)
+{
+	char line[256];
+	int length = snprintf(line, sizeof(line), "%s\n", command);
+
+	double start = now();
+	if (write(shell->master, line, length) != length)
+	{
+		perror("Error writing to shell");
+		exit(1);
+	}
+	waitPrompt(shell);
+	return now() - start;
+}
+
+
+// Asks the shell to exit, and waits for it
+void stopShell(struct shell* shell)
+{
+	const char* line = "exit\n";
+	if (write(shell->master, line, strlen(line)) == -1)
+	{
+		kill(shell->pid, SIGKILL);
+	}
+	waitpid(shell->pid, NULL, 0);
+	close(shell->master);
+}
+
+
+/* **********************************************************************************
+ ** Description: Measures how long the shell takes to reap a background job. The job
+		 sleeps briefly, so that it can be watched with a pidfd - which
+		 becomes readable when it exits - and the benchmark then spins until
+		 its pid has gone, which is when the shell has reaped it
+ ** Input(s): 	 The shell
+ ** Output(s): 	 No output
+ ** Returns: 	 The seconds from the job exiting to it being reaped, or -1 if the job
+		 could not be watched
+ ** *******************************************************************************/
+double reapLatency(struct shell* shell)
+{
+	runCommand(shell, "sleep 0.01 &");
+	char* found = strstr(shell->output, "background pid is ");
+	if (found == NULL)
+	{
+		return -1;
+	}
+	pid_t pid = atoi(found + strlen("background pid is "));
+	int pidFD = syscall(SYS_pidfd_open, pid, 0);
+	if (pidFD == -1)
+	{
+		return -1;
+	}
+
+	struct pollfd exited = { pidFD, POLLIN, 0 };
+	poll(&exited, 1, PROMPT_TIMEOUT);
+	double start = now();
+	while (kill(pid, 0) == 0)
+	{
+		// a zombie can still be signalled - spin until it has gone, giving the shell the
+		// CPU each time round in case there is only one
+		sched_yield();
+	}
+	double latency = now() - start;
+	close(pidFD);
+	return latency;
+}
+
+
+// Compares two doubles, for sorting the samples
+int compareDoubles(const void* a, const void* b)
+{
+	double x = *(const double*)a;
+	double y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+
+// Prints a JSON object summarising samples (in seconds) in the given unit
+void printSummary(const char* name, double* samples, int count, double scale, int last)
+{
+	double total = 0;
+	int i;
+
+	qsort(samples, count, sizeof(double), compareDoubles);
+	for (i = 0; i < count; i++)
+	{
+		total += samples[i];
+	}
+	printf("  \"%s\": { \"samples\": %d, \"min\": %.3f, \"median\": %.3f, \"mean\": %.3f, "
+	       "\"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f }%s\n", name, count,
+	       samples[0] * scale, samples[count / 2] * scale, total / count * scale,
+	       samples[count * 90 / 100] * scale, samples[count * 99 / 100] * scale, samples[count - 1] * scale,
+	       last == 1 ? "" : ",");
+}
+
+
+int main(int argc, char* argv[])
+{
+	int iterations = argc > 1 ? atoi(argv[1]) : 500;
+	char* defaultShell[] = { "./smallsh", NULL };
+	char** command = argc > 2 ? &argv[2] : defaultShell;
+	struct shell shell;
+	int starts = iterations / 10 > 10 ? iterations / 10 : 10;
+	int i;
+
+	if (iterations < 1) { fprintf(stderr, "USAGE: %s [iterations] [shell] [shell arguments...]\n", argv[0]); exit(1); }
+	setenv("HISTFILE", HISTORY_NAME, 1);
+	double* coldStart = malloc(starts * sizeof(double));
+	double* builtin = malloc(iterations * sizeof(double));
+	double* external = malloc(iterations * sizeof(double));
+	double* reap = malloc(iterations * sizeof(double));
+
+	// COLD START - a new shell each time, which exits straight away
+	for (i = 0; i < starts; i++)
+	{
+		coldStart[i] = startShell(&shell, command);
+		stopShell(&shell);
+	}
+
+	// one shell for the rest, warmed up first so that the programs are in the page cache
+	startShell(&shell, command);
+	for (i = 0; i < 20; i++)
+	{
+		runCommand(&shell, "true");
+		runCommand(&shell, "/bin/true");
+	}
+
+	// the two kinds of command take turns, so that both see the same conditions
+	for (i = 0; i < iterations; i++)
+	{
+		builtin[i] = runCommand(&shell, "true");
+		external[i] = runCommand(&shell, "/bin/true");
+	}
+
+	int reaped = 0;
+	for (i = 0; i < iterations; i++)
+	{
+		double latency = reapLatency(&shell);
+		if (latency >= 0)
+		{
+			reap[reaped++] = latency;
+		}
+	}
+
+	char pipeline[128];
+	double best = 0;
+	snprintf(pipeline, sizeof(pipeline), "head -c %d /dev/zero | cat | cat | cat > /dev/null", PIPELINE_BYTES);
+	for (i = 0; i < PIPELINE_RUNS; i++)
+	{
+		double elapsed = runCommand(&shell, pipeline);
+		if (best == 0 || elapsed < best)
+		{
+			best = elapsed;
+		}
+	}
+	stopShell(&shell);
+	unlink(HISTORY_NAME);
+	unlink(HISTORY_NAME ".idx");
+
+	// the difference between the medians is what starting a process costs
+	qsort(builtin, iterations, sizeof(double), compareDoubles);
+	qsort(external, iterations, sizeof(double), compareDoubles);
+	double overhead = external[iterations / 2] - builtin[iterations / 2];
+
+	printf("{\n");
+	printf("  \"shell\": \"%s\",\n", command[0]);
+	printf("  \"iterations\": %d,\n", iterations);
+	printSummary("cold_start_ms", coldStart, starts, 1e3, 0);
+	printSummary("builtin_latency_us", builtin, iterations, 1e6, 0);
+	printSummary("external_latency_us", external, iterations, 1e6, 0);
+	printf("  \"fork_exec_overhead_us\": %.3f,\n", overhead * 1e6);
+	if (reaped > 0)
+	{
+		printSummary("background_reap_latency_us", reap, reaped, 1e6, 0);
+	}
+	else
+	{
+		printf("  \"background_reap_latency_us\": null,\n");
+	}
+	printf("  \"pipeline_throughput_mb_per_s\": %.1f\n", PIPELINE_BYTES / (double)(1 << 20) / best);
+	printf("}\n");
+	return 0;
+}
@@ -0,0 +1,120 @@
+/* **********************************************************************************
+ ** Program Name:   Program 3 - smallsh (bench_script.c)
+ ** Author:         Susan Hibbert
+ ** Date:           20th May 2020
+ ** Description:    Benchmark for running scripts with smallsh. It writes a script
+		    that every shell understands - comments, blank lines, cd and
+		    /bin/true - then runs it with each shell given and reports how many
+		    lines per second each shell got through. The shells' output is
+		    thrown away.
+
+		    USAGE: bench_script [lines] [shell...]
+		    (default: 100000 lines with ./smallsh, /bin/bash and /bin/dash)
+ ** *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define SCRIPT_NAME "bench_script.sh"
+
+// Returns the time in seconds from a monotonic clock
+double now()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+
+/* **********************************************************************************
+ ** Description: Writes the benchmark script. Most lines are handled by the shell
+		 itself, and one line in eight starts a process, so the time reflects
+		 both reading and running commands
+ ** Input(s): 	 Number of lines
+ ** Output(s): 	 Exits with an error message if the script cannot be written
+ ** Returns: 	 No return value
+ ** *******************************************************************************/
+void writeScript(int lines)
+{
+	const char* block[8] = { "# a comment line\n", "cd /\n", "\n", "cd /tmp\n",
+				 "   # an indented comment\n", "cd .\n", "\n", "/bin/true\n" };
+	FILE* script = fopen(SCRIPT_NAME, "w");
+	int i;
+
+	if (script == NULL)
+	{
+		perror("Error writing " SCRIPT_NAME);
+		exit(1);
+	}
+	for (i = 0; i < lines; i++)
+	{
+		fputs(block[i % 8], script);
+	}
+	fclose(script);
+}
+
+
+// Runs the script with a shell, returning the time taken in seconds (or -1 if the shell
+// could not be run)
+double runScript(const char* shell)
+{
+	double start = now();
+	pid_t spawnPid = fork();
+	int exitMethod;
+
+	if (spawnPid == -1)
+	{
+		perror("Error spawning shell");
+		exit(1);
+	}
+	else if (spawnPid == 0)
+	{
+		int devNull = open("/dev/null", O_WRONLY);
+		dup2(devNull, 1);
+		execl(shell, shell, SCRIPT_NAME, NULL);
+		exit(127);
+	}
+
+	waitpid(spawnPid, &exitMethod, 0);
+	if (WIFEXITED(exitMethod) && WEXITSTATUS(exitMethod) == 127)
+	{
+		return -1;
+	}
+	return now() - start;
+}
+
+
+int main(int argc, char* argv[])
+{
+	int lines = argc > 1 ? atoi(argv[1]) : 100000;
+	char* defaultShells[] = { "./smallsh", "/bin/bash", "/bin/dash" };
+	char** shells = argc > 2 ? &argv[2] : defaultShells;
+	int numShells = argc > 2 ? argc - 2 : 3;
+	int i;
+
+	if (lines < 1) { fprintf(stderr, "USAGE: %s [lines] [shell...]\n", argv[0]); exit(1); }
+
+	writeScript(lines);
+	for (i = 0; i < numShells; i++)
+	{
+		double elapsed = runScript(shells[i]);
+		if (elapsed < 0)
+		{
+			printf("%s: could not be run\n", shells[i]);
+		}
+		else
+		{
+			printf("%s: %d lines in %.3f seconds (%.0f lines/second)\n", shells[i], lines, elapsed, lines / elapsed);
+		}
+		fflush(stdout);
+	}
+
+	unlink(SCRIPT_NAME);
+	return 0;
+}
@@ -0,0 +1,552 @@
+/* **********************************************************************************
+ ** Program Name:   Program 3 - smallsh (builtins_smallsh.c)
+ ** Author:         Susan Hibbert
+ ** Date:           20th May 2020
+ ** Description:    Built-in commands for the smallsh program. Built-in commands run
+		    inside the shell itself, without starting a process, so common
+		    commands such as echo and test cost no more than a function call.
+		    Their redirections are applied to the shell's own file descriptors,
+		    which are saved first and put back afterwards
+ ** *******************************************************************************/
+#include "smallsh.h"
+#include <errno.h>
+#include <sys/stat.h>
+
+extern char** environ;
+
+// bool - the shell is a copy running a built-in command in a pipeline (so exit only
+// exits the copy)
+static int inSubshell = 0;
+
+
+// Returns the exit value for an exit method - the exit status, or 128 plus the number of
+// the terminating signal
+int exitValue(int exitMethod)
+{
+	if (WIFSIGNALED(exitMethod) != 0)
+	{
+		return 128 + WTERMSIG(exitMethod);
+	}
+	return WEXITSTATUS(exitMethod);
+}
+
+
+/* **********************************************************************************
+ ** Description: Built-in command exit [n]. Ends every job in the job table (see
+		 jobsShutdown), then exits the shell with exit value n (or the exit value of the last
+		 foreground process)
+ ** Input(s): 	 The command, and pointer to the exit method of the last foreground
+		 process
+ ** Output(s): 	 No output
+ ** Returns: 	 Does not return
+ ** *******************************************************************************/
+static int exitBuiltin(struct command* command, int* childExitMethod)
+{
+	int value = command->argc > 1 ? atoi(command->argv[1]) : exitValue(*childExitMethod);
+
+	// write out anything still buffered, then end all the shell's jobs
+	fflush(stdout);
+	if (inSubshell == 1)
+	{
+		_exit(value);
+	}
+	jobsShutdown();
+	exit(value);
+}
+
+
+// Built-in command cd [dir] - changes to the directory given, or to the directory in the
+// HOME environment variable if no directory is given
+static int cdBuiltin(struct command* command, int* childExitMethod)
+{
+	char* newPath = command->argc > 1 ? command->argv[1] : getenv("HOME");
+	if (newPath != NULL && chdir(newPath) == -1)
+	{
+		perror(newPath);
+		fflush(stderr);		// flush output buffers after printing
+		return 1;
+	}
+	return 0;
+}
+
+
+/* **********************************************************************************
+ ** Description: Prints the resources a job used - wall clock time, user and system
+		 CPU time, maximum resident set size, page faults and context
+		 switches
+ ** Input(s): 	 Where to print, and the resources used
+ ** Output(s): 	 The resources used, one to a line
+ ** Returns: 	 No return value
+ ** *******************************************************************************/
+void printUsage(FILE* stream, struct usage* usage)
+{
+	struct rusage* rusage = &usage->rusage;
+
+	fprintf(stream, "real	%.3fs\n", usage->wall);
+	fprintf(stream, "user	%ld.%03lds\n", (long)rusage->ru_utime.tv_sec, (long)rusage->ru_utime.tv_usec / 1000);
+	fprintf(stream, "sys	%ld.%03lds\n", (long)rusage->ru_stime.tv_sec, (long)rusage->ru_stime.tv_usec / 1000);
+	fprintf(stream, "maxrss	%ld KB\n", rusage->ru_maxrss);
+	fprintf(stream, "faults	%ld major, %ld minor\n", rusage->ru_majflt, rusage->ru_minflt);
+	fprintf(stream, "switches	%ld voluntary, %ld involuntary\n", rusage->ru_nvcsw, rusage->ru_nivcsw);
+}
+
+
+// Built-in command status [-v] - prints out the exit status or the terminating signal of
+// the last foreground process, and with -v, the resources it used
+static int statusBuiltin(struct command* command, int* childExitMethod)
+{
+	if (WIFEXITED(*childExitMethod) != 0)
+	{
+		printf("exit value %d\n", WEXITSTATUS(*childExitMethod));
+	}
+	else if (WIFSIGNALED(*childExitMethod) != 0)
+	{
+		printf("terminated by signal %d\n", WTERMSIG(*childExitMethod));
+	}
+	if (command->argc > 1 && strcmp(command->argv[1], "-v") == 0)
+	{
+		printUsage(stdout, &lastUsage);
+	}
+	return 0;
+}
+
+
+// Built-in command echo [-n] [args...] - prints its arguments separated by spaces, and a
+// newline unless -n is given
+static int echoBuiltin(struct command* command, int* childExitMethod)
+{
+	int newline = command->argc > 1 && strcmp(command->argv[1], "-n") == 0 ? 0 : 1;
+	int i;
+
+	for (i = newline == 1 ? 1 : 2; i < command->argc; i++)
+	{
+		fputs(command->argv[i], stdout);
+		if (i < command->argc - 1)
+		{
+			putchar(' ');
+		}
+	}
+	if (newline == 1)
+	{
+		putchar('\n');
+	}
+	*childExitMethod = EXIT_METHOD(0);
+	return 0;
+}
+
+
+// Built-in commands true and false
+static int trueBuiltin(struct command* command, int* childExitMethod)
+{
+	*childExitMethod = EXIT_METHOD(0);
+	return 0;
+}
+
+static int falseBuiltin(struct command* command, int* childExitMethod)
+{
+	*childExitMethod = EXIT_METHOD(1);
+	return 1;
+}
+
+
+// Built-in command pwd - prints the current directory
+static int pwdBuiltin(struct command* command, int* childExitMethod)
+{
+	char path[PATH_MAX];
+	if (getcwd(path, sizeof(path)) == NULL)
+	{
+		perror("pwd");
+		*childExitMethod = EXIT_METHOD(1);
+		return 1;
+	}
+	puts(path);
+	*childExitMethod = EXIT_METHOD(0);
+	return 0;
+}
+
+
+// Built-in command export [NAME=value...] - sets environment variables, which are passed
+// on to every command run afterwards. With no arguments, prints the environment
+static int exportBuiltin(struct command* command, int* childExitMethod)
+{
+	char** var;
+	int i;
+
+	*childExitMethod = EXIT_METHOD(0);
+	if (command->argc == 1)
+	{
+		for (var = environ; *var != NULL; var++)
+		{
+			printf("export %s\n", *var);
+		}
+		return 0;
+	}
+
+	// a name without a value is already exported if it is set
+	for (i = 1; i < command->argc; i++)
+	{
+		char* equals = strchr(command->argv[i], '=');
+		if (equals == NULL)
+		{
+			continue;
+		}
+		*equals = '\0';
+		if (equals == command->argv[i] || setenv(command->argv[i], equals + 1, 1) == -1)
+		{
+			fprintf(stderr, "export: %s: not a valid identifier\n", command->argv[i]);
+			*childExitMethod = EXIT_METHOD(1);
+		}
+		*equals = '=';
+	}
+	return exitValue(*childExitMethod);
+}
+
+
+// Built-in command unset NAME... - removes environment variables
+static int unsetBuiltin(struct command* command, int* childExitMethod)
+{
+	int i;
+	for (i = 1; i < command->argc; i++)
+	{
+		unsetenv(command->argv[i]);
+	}
+	*childExitMethod = EXIT_METHOD(0);
+	return 0;
+}
+
+
+/* **********************************************************************************
+ ** Description: Evaluates an expression for the test command - a string on its own
+		 (true if it is not empty), a unary test (-e -f -d -r -w -x -s on a
+		 file, -n -z on a string), a binary test (= != on strings, -eq -ne -lt
+		 -le -gt -ge on integers), or any of these preceded by !
+ ** Input(s): 	 Number of words in the expression, and the words
+ ** Output(s): 	 Displays an error message if the expression is not understood
+ ** Returns: 	 Returns 0 if the expression is true, 1 if it is false, or 2 if there
+		 is an error
+ ** *******************************************************************************/
+static int evalTest(int argc, char** argv)
+{
+	if (argc == 0)
+	{
+		return 1;
+	}
+	if (strcmp(argv[0], "!") == 0 && argc > 1)
+	{
+		int result = evalTest(argc - 1, argv + 1);
+		return result == 2 ? 2 : !result;
+	}
+	if (argc == 1)
+	{
+		return argv[0][0] != '\0' ? 0 : 1;
+	}
+
+	if (argc == 2)
+	{
+		const char* op = argv[0];
+		const char* arg = argv[1];
+		struct stat fileInfo;
+
+		if (strcmp(op, "-n") == 0) return arg[0] != '\0' ? 0 : 1;
+		if (strcmp(op, "-z") == 0) return arg[0] == '\0' ? 0 : 1;
+		if (strcmp(op, "-r") == 0) return access(arg, R_OK) == 0 ? 0 : 1;
+		if (strcmp(op, "-w") == 0) return access(arg, W_OK) == 0 ? 0 : 1;
+		if (strcmp(op, "-x") == 0) return access(arg, X_OK) == 0 ? 0 : 1;
+		if (strcmp(op, "-e") != 0 && strcmp(op, "-f") != 0 && strcmp(op, "-d") != 0 && strcmp(op, "-s") != 0)
+		{
+			fprintf(stderr, "test: %s: unary operator expected\n", op);
+			return 2;
+		}
+		if (stat(arg, &fileInfo) == -1) return 1;
+		if (op[1] == 'f') return S_ISREG(fileInfo.st_mode) ? 0 : 1;
+		if (op[1] == 'd') return S_ISDIR(fileInfo.st_mode) ? 0 : 1;
+		if (op[1] == 's') return fileInfo.st_size > 0 ? 0 : 1;
+		return 0;
+	}
+
+	if (argc == 3)
+	{
+		const char* op = argv[1];
+		if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0) return strcmp(argv[0], argv[2]) == 0 ? 0 : 1;
+		if (strcmp(op, "!=") == 0) return strcmp(argv[0], argv[2]) != 0 ? 0 : 1;
+
+		const char* ops[6] = { "-eq", "-ne", "-lt", "-le", "-gt", "-ge" };
+		char* end1;
+		char* end2;
+		long a = strtol(argv[0], &end1, 10);
+		long b = strtol(argv[2], &end2, 10);
+		int i;
+		for (i = 0; i < 6 && strcmp(op, ops[i]) != 0; i++);
+		if (i == 6)
+		{
+			fprintf(stderr, "test: %s: binary operator expected\n", op);
+			return 2;
+		}
+		if (*end1 != '\0' || *end2 != '\0' || argv[0][0] == '\0' || argv[2][0] == '\0')
+		{
+			fprintf(stderr, "test: integer expression expected\n");
+			return 2;
+		}
+		int result[6] = { a == b, a != b, a < b, a <= b, a > b, a >= b };
+		return result[i] ? 0 : 1;
+	}
+
+	fprintf(stderr, "test: too many arguments\n");
+	return 2;
+}
+
+
+// Built-in commands test expr and [ expr ]
+static int testBuiltin(struct command* command, int* childExitMethod)
+{
+	int argc = command->argc - 1;
+
+	// [ must be closed by ]
+	if (strcmp(command->argv[0], "[") == 0)
+	{
+		if (argc == 0 || strcmp(command->argv[argc], "]") != 0)
+		{
+			fprintf(stderr, "[: missing ']'\n");
+			*childExitMethod = EXIT_METHOD(2);
+			return 2;
+		}
+		argc--;
+	}
+
+	int result = evalTest(argc, command->argv + 1);
+	*childExitMethod = EXIT_METHOD(result);
+	return result;
+}
+
+
+// Converts a signal name (HUP, SIGHUP) or number to a signal number. Returns -1 if it is
+// not recognised
+static int signalNumber(const char* name)
+{
+	const char* names[] = { "HUP", "INT", "QUIT", "ILL", "TRAP", "ABRT", "BUS", "FPE", "KILL", "USR1",
+				"SEGV", "USR2", "PIPE", "ALRM", "TERM", "STKFLT", "CHLD", "CONT", "STOP", "TSTP" };
+	int numbers[] = { SIGHUP, SIGINT, SIGQUIT, SIGILL, SIGTRAP, SIGABRT, SIGBUS, SIGFPE, SIGKILL, SIGUSR1,
+			  SIGSEGV, SIGUSR2, SIGPIPE, SIGALRM, SIGTERM, SIGSTKFLT, SIGCHLD, SIGCONT, SIGSTOP, SIGTSTP };
+	char* end;
+	int i;
+
+	long number = strtol(name, &end, 10);
+	if (*end == '\0' && end != name)
+	{
+		return number >= 0 && number < NSIG ? number : -1;
+	}
+	if (strncmp(name, "SIG", 3) == 0)
+	{
+		name += 3;
+	}
+	for (i = 0; i < (int)(sizeof(numbers) / sizeof(numbers[0])); i++)
+	{
+		if (strcmp(name, names[i]) == 0)
+		{
+			return numbers[i];
+		}
+	}
+	return -1;
+}
+
+
+// Built-in command kill [-SIGNAL | -s SIGNAL] pid|%job... - sends a signal (SIGTERM if
+// none is given) to processes, or to every process of a job
+static int killBuiltin(struct command* command, int* childExitMethod)
+{
+	int sig = SIGTERM;
+	int i = 1;
+	int result = 0;
+
+	if (i < command->argc && strcmp(command->argv[i], "-s") == 0 && i + 1 < command->argc)
+	{
+		sig = signalNumber(command->argv[i + 1]);
+		i += 2;
+	}
+	else if (i < command->argc && command->argv[i][0] == '-' && command->argv[i][1] != '\0')
+	{
+		sig = signalNumber(command->argv[i] + 1);
+		i++;
+	}
+	if (sig == -1)
+	{
+		fprintf(stderr, "kill: %s: invalid signal specification\n", command->argv[i - 1]);
+		*childExitMethod = EXIT_METHOD(1);
+		return 1;
+	}
+	if (i == command->argc)
+	{
+		fprintf(stderr, "kill: usage: kill [-s sigspec | -sigspec] pid | %%job ...\n");
+		*childExitMethod = EXIT_METHOD(2);
+		return 2;
+	}
+
+	for (; i < command->argc; i++)
+	{
+		pid_t target;
+		if (command->argv[i][0] == '%')
+		{
+			struct job* job = findJob("kill", command->argv[i]);
+			if (job == NULL)
+			{
+				result = 1;
+				continue;
+			}
+			target = -job->pgid;
+		}
+		else
+		{
+			target = atoi(command->argv[i]);
+		}
+
+		if (kill(target, sig) == -1)
+		{
+			fprintf(stderr, "kill: (%s) - %s\n", command->argv[i], strerror(errno));
+			result = 1;
+		}
+	}
+	*childExitMethod = EXIT_METHOD(result);
+	return result;
+}
+
+
+// the built-in commands, in order of name so they can be found with a binary search
+static const struct builtin
+{
+	const char* name;
+	builtinFunction run;
+	int inShell;			// bool - runs in the shell itself, rather than in a copy of
+					// the shell started as a job
+} builtins[] = {
+	{ "[", testBuiltin, 1 },
+	{ "bg", bgBuiltin, 1 },
+	{ "cd", cdBuiltin, 1 },
+	{ "cgroup", cgroupBuiltin, 1 },
+	{ "coproc", coprocBuiltin, 1 },
+	{ "disown", disownBuiltin, 1 },
+	{ "echo", echoBuiltin, 1 },
+	{ "exit", exitBuiltin, 1 },
+	{ "export", exportBuiltin, 1 },
+	{ "false", falseBuiltin, 1 },
+	{ "fg", fgBuiltin, 1 },
+	{ "hash", hashBuiltin, 1 },
+	{ "history", historyBuiltin, 1 },
+	{ "jobs", jobsBuiltin, 1 },
+	{ "kill", killBuiltin, 1 },
+	{ "parallel", parallelBuiltin, 0 },
+	{ "pwd", pwdBuiltin, 1 },
+	{ "status", statusBuiltin, 1 },
+	{ "test", testBuiltin, 1 },
+	{ "true", trueBuiltin, 1 },
+	{ "ulimit", ulimitBuiltin, 1 },
+	{ "unset", unsetBuiltin, 1 },
+	{ "wait", waitBuiltin, 1 },
+};
+
+
+// Compares a command name with a built-in command's name, for bsearch
+static int compareBuiltin(const void* name, const void* entry)
+{
+	return strcmp(name, ((const struct builtin*)entry)->name);
+}
+
+
+// Returns the table entry for a built-in command, or NULL if the name is not a built-in
+// command. The name must match exactly, so commands which only contain the name of a
+// built-in command (such as echo abcd) are not mistaken for it
+static const struct builtin* lookupBuiltin(const char* name)
+{
+	return bsearch(name, builtins, sizeof(builtins) / sizeof(builtins[0]), sizeof(struct builtin), compareBuiltin);
+}
+
+
+// Returns the function for a built-in command, or NULL if the name is not a built-in command
+builtinFunction findBuiltin(const char* name)
+{
+	const struct builtin* entry = lookupBuiltin(name);
+	return entry != NULL ? entry->run : NULL;
+}
+
+
+// Returns 1 if the name is a built-in command which runs in the shell itself, 0 otherwise
+int builtinInShell(const char* name)
+{
+	const struct builtin* entry = lookupBuiltin(name);
+	return entry != NULL && entry->inShell == 1;
+}
+
+
+/* **********************************************************************************
+ ** Description: Runs a command if it is a built-in command. Its redirections are
+		 applied to the shell's own file descriptors, which are copied first
+		 and put back once the command is done (see redirect_smallsh.c). The built-in commands exit,
+		 cd and status leave the exit status reported by status alone, the
+		 others set it
+ ** Input(s): 	 The command, and pointer to the exit method of the last foreground
+		 process
+ ** Output(s): 	 Output of the built-in command
+ ** Returns: 	 Returns 1 if the command was run, or 0 if it is not a built-in command
+		 or is one which runs as a job (such as parallel)
+ ** *******************************************************************************/
+int runBuiltin(struct command* command, int* childExitMethod)
+{
+	const struct builtin* entry = lookupBuiltin(command->argv[0]);
+	int saved[MAX_REDIRECT_FD + 1];		// copies of the file descriptors redirected
+	int fd;
+
+	// built-in commands which run as a job are started like any other command
+	if (entry == NULL || entry->inShell == 0)
+	{
+		return 0;
+	}
+
+	// anything already buffered belongs to the old stdout. Output of built-in commands
+	// without redirections is left in the buffer, like any other output of the shell
+	if (command->redirects != NULL)
+	{
+		fflush(stdout);
+	}
+	for (fd = 0; fd <= MAX_REDIRECT_FD; fd++)
+	{
+		saved[fd] = -1;
+	}
+
+	// process substitutions are started before the redirections, which may name them
+	if (startSubstitutions(command, *childExitMethod) == -1)
+	{
+		*childExitMethod = EXIT_METHOD(1);
+		return 1;
+	}
+
+	int failed = applyRedirects(command->redirects, saved);
+	if (failed == 0)
+	{
+		entry->run(command, childExitMethod);
+	}
+	else
+	{
+		*childExitMethod = EXIT_METHOD(1);
+	}
+
+	// put the shell's own file descriptors back
+	if (command->redirects != NULL)
+	{
+		fflush(stdout);
+	}
+	restoreRedirects(saved);
+	closeSubstitutions(command);
+	return 1;
+}
+
+
+// Runs a built-in command in a copy of the shell started for a pipeline, whose
+// redirections have already been applied, and exits the copy with the command's exit
+// value. The copy leaves with _exit, as exit would move the file offset of the stdin it
+// shares with the shell back to where the shell's stdio had read up to
+void execBuiltin(struct command* command, int childExitMethod)
+{
+	inSubshell = 1;
+	int value = findBuiltin(command->argv[0])(command, &childExitMethod);
+	fflush(stdout);
+	_exit(value);
+}
@@ -0,0 +1,233 @@
+/* **********************************************************************************
+ ** Program Name:   Program 3 - smallsh (events_smallsh.c)
+ ** Author:         Susan Hibbert
+ ** Date:           20th May 2020
+ ** Description:    Event loop for the smallsh program. The shell has no signal
+		    handlers: SIGCHLD, SIGINT, SIGTSTP and SIGHUP are blocked, and read
+		    from a signalfd instead. Whenever the shell waits - for a line at the
+		    prompt or for a foreground job - it sleeps in epoll_wait on stdin
+		    and the signalfd, and handles each signal in turn as an ordinary
+		    part of the loop: children are reaped (see jobs_smallsh.c), CTRL-C
+		    is passed on to the foreground job, CTRL-Z at the prompt switches
+		    foreground-only mode on or off, and a hangup ends the jobs and the
+		    shell. Nothing runs at an unexpected time,
+		    so the signals can safely use stdio and the job table
+ ** *******************************************************************************/
+#include "smallsh.h"
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+
+#define MAX_EVENTS 8		// events taken from epoll at a time
+
+// global bool variable to check if SIGTSTP signal has been received and if the shell is
+// only running foreground process
+// 0 = Shell operating normally - background and foreground processes can be run
+// 1 = SIGTSTP signal has been received - in foreground-only mode
+int foregroundMode = 0;
+
+// signal mask the shell started with, which its children are given back
+sigset_t childMask;
+
+static int signalFD = -1;		// signalfd for SIGCHLD, SIGINT, SIGTSTP and SIGHUP
+static int epollFD = -1;		// epoll instance watching signalFD and stdin
+
+// stdin is watched one line at a time (EPOLLONESHOT), so that input typed while a job
+// runs does not wake the shell until it wants the next line
+static int stdinWatched = 0;		// bool - stdin has been added to epollFD
+static int stdinArmed = 0;		// bool - epoll will report stdin once it is readable
+static int stdinReady = 0;		// bool - stdin became readable while waiting for a job
+static int stdinIsFile = 0;		// bool - stdin is a regular file, which is always readable
+
+
+/* **********************************************************************************
+ ** Description: Sets up the event loop - blocks SIGCHLD, SIGINT, SIGTSTP and SIGHUP,
+		 so that they are only received through the signalfd, and creates the epoll
+		 instance that watches it. Children are given back the signal mask the
+		 shell started with (see spawnStage)
+ ** Input(s): 	 No input
+ ** Output(s): 	 Exits with an error message if the signalfd or epoll instance cannot
+		 be created
+ ** Returns: 	 No return value
+ ** *******************************************************************************/
+void eventsInit()
+{
+	sigset_t handled;
+	sigemptyset(&handled);
+	sigaddset(&handled, SIGCHLD);
+	sigaddset(&handled, SIGINT);
+	sigaddset(&handled, SIGTSTP);
+	sigaddset(&handled, SIGHUP);
+
+	// a signal the shell was started ignoring would never reach the signalfd. SIGHUP is
+	// left ignored, for a shell started with nohup
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTSTP, SIG_DFL);
+	sigprocmask(SIG_BLOCK, &handled, &childMask);
+
+	struct epoll_event event = {0};
+	signalFD = signalfd(-1, &handled, SFD_NONBLOCK | SFD_CLOEXEC);
+	epollFD = epoll_create1(EPOLL_CLOEXEC);
+	event.events = EPOLLIN;
+	event.data.fd = signalFD;
+	if (signalFD == -1 || epollFD == -1 || epoll_ctl(epollFD, EPOLL_CTL_ADD, signalFD, &event) == -1)
+	{
+		perror("Unable to set up signal handling\n");
+		exit(1);
+	}
+}
+
+
+// Switches foreground-only mode on or off (CTRL-Z). When it is on, & is ignored
+static void toggleForegroundMode()
+{
+	// if receiving first SIGTSTP signal, put shell in foreground-only mode
+	if (foregroundMode == 0)
+	{
+		printf("\nEntering foreground-only mode (& is now ignored)\n:");
+		foregroundMode = 1;
+	}
+	// if previously received one SIGTSTP signal and currently operating in foreground
+	// only mode, switch back to normal shell operation
+	else
+	{
+		printf("\nExiting foreground-only mode\n:");
+		foregroundMode = 0;
+	}
+	fflush(stdout);		// flush output buffers after printing
+}
+
+
+/* **********************************************************************************
+ ** Description: Handles every signal waiting on the signalfd, without blocking.
+		 SIGINT (CTRL-C) is passed on to the foreground job, if there is one -
+		 the shell itself is not terminated by it. SIGTSTP (CTRL-Z) switches
+		 foreground-only mode. SIGHUP (the terminal has gone) ends the shell's
+		 jobs and exits. After a SIGCHLD, every child which has changed
+		 state is reaped. The signals are read before the children are reaped,
+		 so a child which changes state afterwards sends a new SIGCHLD
+ ** Input(s): 	 No input
+ ** Output(s): 	 A message when foreground-only mode is switched
+ ** Returns: 	 No return value
+ ** *******************************************************************************/
+void eventsPoll()
+{
+	struct signalfd_siginfo info[16];
+	ssize_t bytesRead;
+	int childChanged = 0;
+	int i;
+
+	while ((bytesRead = read(signalFD, info, sizeof(info))) > 0)
+	{
+		for (i = 0; i < bytesRead / (ssize_t)sizeof(info[0]); i++)
+		{
+			switch (info[i].ssi_signo)
+			{
+				case SIGCHLD:
+					childChanged = 1;
+					break;
+				case SIGINT:
+					if (foregroundPgid > 0)
+					{
+						kill(-foregroundPgid, SIGINT);
+					}
+					break;
+				case SIGTSTP:
+					toggleForegroundMode();
+					break;
+				case SIGHUP:
+					jobsShutdown();
+					exit(128 + SIGHUP);
+			}
+		}
+	}
+	if (childChanged == 1)
+	{
+		reapChildren();
+	}
+}
+
+
+// Asks epoll to report stdin once it is readable. Returns 0, or -1 if stdin cannot be
+// watched because it is a regular file
+static int armStdin()
+{
+	struct epoll_event event = {0};
+	event.events = EPOLLIN | EPOLLONESHOT;
+	event.data.fd = STDIN_FILENO;
+
+	if (epoll_ctl(epollFD, stdinWatched == 1 ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, STDIN_FILENO, &event) == -1)
+	{
+		return -1;
+	}
+	stdinWatched = 1;
+	stdinArmed = 1;
+	return 0;
+}
+
+
+/* **********************************************************************************
+ ** Description: Sleeps until something happens, handling every signal that arrives
+		 meanwhile (see eventsPoll). When waiting for input, it returns once
+		 stdin is readable. Otherwise it returns after one round of signals,
+		 so the caller can check whether what it is waiting for has happened -
+		 unless the shell has no children left to wait for
+ ** Input(s): 	 bool - wait for stdin to be readable
+ ** Output(s): 	 A message when foreground-only mode is switched
+ ** Returns: 	 Returns 1 if stdin is readable, 0 once signals have been handled,
+		 or -1 if there is nothing to wait for
+ ** *******************************************************************************/
+int eventsWait(int forInput)
+{
+	struct epoll_event events[MAX_EVENTS];
+	int i;
+
+	if (forInput == 1 && stdinIsFile == 0 && stdinReady == 0 && stdinArmed == 0 && armStdin() == -1)
+	{
+		stdinIsFile = 1;
+	}
+	if (forInput == 1 && (stdinIsFile == 1 || stdinReady == 1))
+	{
+		eventsPoll();
+		stdinReady = 0;
+		return 1;
+	}
+
+	// a copy of the shell (such as a built-in command in a pipeline) has none of the
+	// shell's children, and no signals come to its signalfd
+	if (forInput == 0 && reapChildren() == -1)
+	{
+		return -1;
+	}
+
+	while (1)
+	{
+		int count = epoll_wait(epollFD, events, MAX_EVENTS, -1);
+		if (count == -1 && errno != EINTR)
+		{
+			return -1;
+		}
+		for (i = 0; i < count; i++)
+		{
+			if (events[i].data.fd == signalFD)
+			{
+				eventsPoll();
+			}
+			else
+			{
+				stdinArmed = 0;
+				stdinReady = 1;
+			}
+		}
+
+		if (forInput == 0)
+		{
+			return 0;
+		}
+		if (stdinReady == 1)
+		{
+			stdinReady = 0;
+			return 1;
+		}
+	}
+}
@@ -0,0 +1,598 @@
+/* **********************************************************************************
+ ** Program Name:   Program 3 - smallsh (glob_smallsh.c)
+ ** Author:         Susan Hibbert
+ ** Date:           20th May 2020
+ ** Description:    Filename expansion for the smallsh program. A word of a command
+		    holding * (any characters), ? (any one character) or [...] (one
+		    of a set of characters, [!...] or [^...] for any other) is replaced
+		    by the names of the files it matches, in sorted order. A path
+		    component of ** matches any number of directories, including
+		    none. A name beginning with . is only matched by a pattern
+		    beginning with ., and a word that matches nothing is left as it is.
+
+		    Each component of a pattern is compiled once into a list of
+		    operations, which is then matched against every name in the
+		    directory. Directories are read with getdents64 into the parser's
+		    arena, and kept there until the next line, so a line with many
+		    patterns in one directory reads it only once
+ ** *******************************************************************************/
+#include "smallsh.h"
+#include <errno.h>
+#include <dirent.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#define LISTING_BUFFER_SIZE 32768	// bytes of directory entries read at a time
+
+// operations a compiled pattern is made of
+#define OP_CHAR 0		// one given character
+#define OP_ANY 1		// any one character (?)
+#define OP_STAR 2		// any characters, including none (*)
+#define OP_SET 3		// one of a set of characters ([...])
+
+struct globOp
+{
+	int type;
+	unsigned char c;		// the character (OP_CHAR)
+	const uint8_t* set;		// bit map of the characters in the set (OP_SET)
+};
+
+// a compiled path component
+struct globPattern
+{
+	struct globOp* ops;
+	int numOps;
+	int wild;			// bool - it has a *, ? or set, so must be matched
+	int dot;			// bool - it may match a name beginning with .
+	int recursive;			// bool - it is **, which matches any number of directories
+};
+
+// a name in a directory listing
+struct globEntry
+{
+	const char* name;
+	unsigned char type;		// DT_DIR, DT_LNK and so on, DT_UNKNOWN if not given
+	struct globEntry* next;
+};
+
+// the names in a directory, read once per line
+struct globListing
+{
+	const char* path;		// the directory, as given in the pattern ("" for .)
+	struct globEntry* entries;	// NULL if it is empty or cannot be read
+	struct globListing* next;
+};
+
+// a match found, before they are sorted
+struct globMatch
+{
+	char* path;
+	struct globMatch* next;
+};
+
+// what a word is expanded with
+struct globState
+{
+	struct arena* arena;
+	struct globPattern* components;	// the compiled components of the pattern
+	int numComponents;
+	int trailingSlash;		// bool - the pattern ends with /, so only directories match
+	struct globMatch* matches;
+	int numMatches;
+	char path[PATH_MAX];		// the path being built
+};
+
+// layout of the records getdents64 returns
+struct linuxDirent64
+{
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+
+// Checks whether a word has anything to expand - a *, a ?, or a [ with a ] after it
+int globHasPattern(const char* word)
+{
+	const char* c;
+	for (c = word; *c != '\0'; c++)
+	{
+		if (*c == '*' || *c == '?' || (*c == '[' && c[1] != '\0' && strchr(c + 2, ']') != NULL))
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
+/* **********************************************************************************
+ ** Description: Compiles one path component of a pattern into its operations. A set
+		 is compiled into a bit map of the 256 characters, so matching a
+		 character against it is a single lookup. A [ with no ] after it is
+		 an ordinary character
+ ** Input(s): 	 The arena, the component and its length, and the pattern to fill in
+ ** Output(s): 	 No output
+ ** Returns: 	 Returns 0, or -1 if memory cannot be allocated
+ ** *******************************************************************************/
+static int compileComponent(struct arena* arena, const char* text, size_t length, struct globPattern* pattern)
+{
+	size_t i = 0;
+
+	// there is at most one operation per character
+	pattern->ops = arenaAlloc(arena, (length + 1) * sizeof(struct globOp));
+	if (pattern->ops == NULL)
+	{
+		return -1;
+	}
+	pattern->numOps = 0;
+	pattern->wild = 0;
+	pattern->dot = length > 0 && text[0] == '.';
+	pattern->recursive = length == 2 && text[0] == '*' && text[1] == '*';
+
+	while (i < length)
+	{
+		struct globOp* op = &pattern->ops[pattern->numOps++];
+		unsigned char c = text[i];
+		if (c == '*')
+		{
+			// a run of stars is the same as one
+			if (pattern->numOps > 1 && op[-1].type == OP_STAR)
+			{
+				pattern->numOps--;
+			}
+			op->type = OP_STAR;
+			pattern->wild = 1;
+			i++;
+			continue;
+		}
+		if (c == '?')
+		{
+			op->type = OP_ANY;
+			pattern->wild = 1;
+			i++;
+			continue;
+		}
+
+		// find the end of a set - a ] straight after [, [! or [^ is part of it
+		size_t end = i + 1;
+		if (c == '[')
+		{
+			if (end < length && (text[end] == '!' || text[end] == '^')) end++;
+			if (end < length && text[end] == ']') end++;
+			while (end < length && text[end] != ']') end++;
+		}
+		if (c != '[' || end >= length)
+		{
+			op->type = OP_CHAR;
+			op->c = c;
+			i++;
+			continue;
+		}
+
+		uint8_t* set = arenaAlloc(arena, 32);
+		if (set == NULL)
+		{
+			return -1;
+		}
+		memset(set, 0, 32);
+		size_t j = i + 1;
+		int negate = text[j] == '!' || text[j] == '^';
+		if (negate == 1) j++;
+		int first = 1;
+		for (; j < end; j++, first = 0)
+		{
+			unsigned char low = text[j];
+			unsigned char high = low;
+			if (j + 2 < end && text[j + 1] == '-' && (first == 0 || low != ']'))
+			{
+				high = text[j + 2];
+				j += 2;
+			}
+			unsigned int k;
+			for (k = low; k <= high; k++)
+			{
+				set[k >> 3] |= 1 << (k & 7);
+			}
+		}
+		if (negate == 1)
+		{
+			for (j = 0; j < 32; j++) set[j] = ~set[j];
+		}
+		op->type = OP_SET;
+		op->set = set;
+		pattern->wild = 1;
+		i = end + 1;
+	}
+	return 0;
+}
+
+
+/* **********************************************************************************
+ ** Description: Matches a name against a compiled component. The name is read from
+		 left to right, and on a mismatch the last * is made to take one more
+		 character, which is enough as the part after a later * can always
+		 be matched at least as early - so the time taken is at most the
+		 length of the name times the length of the pattern
+ ** Input(s): 	 The compiled component and the name
+ ** Output(s): 	 No output
+ ** Returns: 	 Returns 1 if the name matches, otherwise 0
+ ** *******************************************************************************/
+static int matchComponent(const struct globPattern* pattern, const char* name)
+{
+	const struct globOp* ops = pattern->ops;
+	int numOps = pattern->numOps;
+	int op = 0;
+	int starOp = -1;
+	const char* starName = NULL;
+	const char* c = name;
+
+	// . and .. are never matched, and other hidden names only by a leading .
+	if (name[0] == '.' && (pattern->dot == 0 || name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+	{
+		return 0;
+	}
+
+	while (*c != '\0')
+	{
+		unsigned char ch = *c;
+		if (op < numOps && ops[op].type == OP_STAR)
+		{
+			starOp = op++;
+			starName = c;
+			continue;
+		}
+		if (op < numOps && (ops[op].type == OP_ANY || (ops[op].type == OP_CHAR && ops[op].c == ch) ||
+				     (ops[op].type == OP_SET && (ops[op].set[ch >> 3] & (1 << (ch & 7))) != 0)))
+		{
+			op++;
+			c++;
+			continue;
+		}
+		if (starOp == -1)
+		{
+			return 0;
+		}
+		op = starOp + 1;
+		c = ++starName;
+	}
+	while (op < numOps && ops[op].type == OP_STAR)
+	{
+		op++;
+	}
+	return op == numOps;
+}
+
+
+/* **********************************************************************************
+ ** Description: Gets the names in a directory, reading it with getdents64 the first
+		 time it is needed on this line. The listing is kept in the arena,
+		 which is reset before the next line
+ ** Input(s): 	 The arena and the directory, "" for the current directory
+ ** Output(s): 	 No output
+ ** Returns: 	 The first name (NULL if there are none, or the directory cannot be
+		 read), with *full set if memory could not be allocated
+ ** *******************************************************************************/
+static struct globEntry* readListing(struct arena* arena, const char* path, int* full)
+{
+	struct globListing* listing;
+
+	for (listing = arena->listings; listing != NULL; listing = listing->next)
+	{
+		if (strcmp(listing->path, path) == 0)
+		{
+			return listing->entries;
+		}
+	}
+
+	size_t pathLength = strlen(path);
+	listing = arenaAlloc(arena, sizeof(struct globListing));
+	char* copy = arenaAlloc(arena, pathLength + 1);
+	if (listing == NULL || copy == NULL)
+	{
+		*full = 1;
+		return NULL;
+	}
+	memcpy(copy, path, pathLength + 1);
+	listing->path = copy;
+	listing->entries = NULL;
+	listing->next = arena->listings;
+	arena->listings = listing;
+
+	int fd = open(path[0] == '\0' ? "." : path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd == -1)
+	{
+		return NULL;
+	}
+
+	// the names are added to the front of the list, as the order does not matter
+	static char buffer[LISTING_BUFFER_SIZE];
+	long bytesRead;
+	while ((bytesRead = syscall(SYS_getdents64, fd, buffer, sizeof(buffer))) > 0)
+	{
+		long offset;
+		for (offset = 0; offset < bytesRead; )
+		{
+			struct linuxDirent64* dirent = (struct linuxDirent64*)(buffer + offset);
+			offset += dirent->d_reclen;
+
+			size_t length = strlen(dirent->d_name);
+			struct globEntry* entry = arenaAlloc(arena, sizeof(struct globEntry));
+			char* name = arenaAlloc(arena, length + 1);
+			if (entry == NULL || name == NULL)
+			{
+				close(fd);
+				*full = 1;
+				return NULL;
+			}
+			memcpy(name, dirent->d_name, length + 1);
+			entry->name = name;
+			entry->type = dirent->d_type;
+			entry->next = listing->entries;
+			listing->entries = entry;
+		}
+	}
+	close(fd);
+	return listing->entries;
+}
+
+
+// Checks whether a path is a directory, following a symbolic link unless noLinks is set.
+// The type from the listing is used where it is known
+static int isDirectory(const char* path, unsigned char type, int noLinks)
+{
+	struct stat info;
+	if (type == DT_DIR)
+	{
+		return 1;
+	}
+	if (type != DT_UNKNOWN && (type != DT_LNK || noLinks == 1))
+	{
+		return 0;
+	}
+	return fstatat(AT_FDCWD, path, &info, noLinks == 1 ? AT_SYMLINK_NOFOLLOW : 0) == 0 && S_ISDIR(info.st_mode);
+}
+
+
+// Adds the path being built to the matches. Returns 0, or -1 if memory cannot be allocated
+static int addMatch(struct globState* state, size_t length)
+{
+	struct globMatch* match = arenaAlloc(state->arena, sizeof(struct globMatch));
+	char* path = arenaAlloc(state->arena, length + 1);
+	if (match == NULL || path == NULL)
+	{
+		return -1;
+	}
+	memcpy(path, state->path, length);
+	path[length] = '\0';
+	match->path = path;
+	match->next = state->matches;
+	state->matches = match;
+	state->numMatches++;
+	return 0;
+}
+
+
+/* **********************************************************************************
+ ** Description: Matches the components of the pattern from the given one on, below
+		 the path built so far. A component with nothing to match is added to
+		 the path without reading the directory, and the path is checked for
+		 at the end. ** tries the rest of the pattern here and in every
+		 directory below, not following symbolic links so that a loop cannot
+		 be entered
+ ** Input(s): 	 The state, the component to match next, the length of the path so
+		 far, and bool - the path is not yet known to exist
+ ** Output(s): 	 No output
+ ** Returns: 	 Returns 0, or -1 if memory cannot be allocated
+ ** *******************************************************************************/
+static int expandFrom(struct globState* state, int index, size_t length, int unchecked)
+{
+	struct stat info;
+	int full = 0;
+
+	if (index == state->numComponents)
+	{
+		if (unchecked == 1 && fstatat(AT_FDCWD, state->path, &info, AT_SYMLINK_NOFOLLOW) == -1)
+		{
+			return 0;
+		}
+		if (state->trailingSlash == 1)
+		{
+			if (isDirectory(state->path, DT_UNKNOWN, 0) == 0 || length + 1 >= PATH_MAX)
+			{
+				return 0;
+			}
+			state->path[length++] = '/';
+			state->path[length] = '\0';
+		}
+		return addMatch(state, length);
+	}
+
+	// components are joined by /
+	size_t start = length;
+	if (length > 0 && state->path[length - 1] != '/')
+	{
+		if (length + 1 >= PATH_MAX) return 0;
+		state->path[start++] = '/';
+		state->path[start] = '\0';
+	}
+
+	struct globPattern* pattern = &state->components[index];
+	int recursive = pattern->recursive;
+	int last = index + 1 == state->numComponents;
+	if (pattern->wild == 0)
+	{
+		size_t textLength = pattern->numOps;
+		if (start + textLength >= PATH_MAX) return 0;
+		int i;
+		for (i = 0; i < pattern->numOps; i++)
+		{
+			state->path[start + i] = pattern->ops[i].c;
+		}
+		state->path[start + textLength] = '\0';
+		return expandFrom(state, index + 1, start + textLength, 1);
+	}
+
+	// the directory to read is the path so far, without the / just added
+	state->path[length] = '\0';
+	struct globEntry* entry = readListing(state->arena, state->path, &full);
+	if (full == 1)
+	{
+		return -1;
+	}
+	if (start > length)
+	{
+		state->path[length] = '/';
+	}
+
+	// ** matches no directories too, so the rest of the pattern is tried here first. At the
+	// end of the pattern, it matches every name below
+	if (recursive == 1 && last == 0)
+	{
+		state->path[length] = '\0';
+		if (expandFrom(state, index + 1, length, unchecked) == -1)
+		{
+			return -1;
+		}
+		if (start > length)
+		{
+			state->path[length] = '/';
+		}
+	}
+	for (; entry != NULL; entry = entry->next)
+	{
+		if (matchComponent(pattern, entry->name) == 0)
+		{
+			continue;
+		}
+		size_t nameLength = strlen(entry->name);
+		if (start + nameLength >= PATH_MAX)
+		{
+			continue;
+		}
+		memcpy(state->path + start, entry->name, nameLength + 1);
+		size_t end = start + nameLength;
+
+		int result = 0;
+		if (recursive == 1)
+		{
+			if (last == 1)
+			{
+				result = expandFrom(state, index + 1, end, 0);
+			}
+			if (result == 0 && isDirectory(state->path, entry->type, 1) == 1)
+			{
+				result = expandFrom(state, index, end, 0);
+			}
+		}
+		else if (last == 1)
+		{
+			result = expandFrom(state, index + 1, end, 0);
+		}
+		else if (isDirectory(state->path, entry->type, 0) == 1)
+		{
+			result = expandFrom(state, index + 1, end, 0);
+		}
+		if (result == -1)
+		{
+			return -1;
+		}
+		state->path[end] = '\0';
+	}
+	return 0;
+}
+
+
+// Compares two paths, for sorting the matches
+static int compareMatches(const void* a, const void* b)
+{
+	return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+
+/* **********************************************************************************
+ ** Description: Expands a word holding a pattern into the names of the files it
+		 matches. The pattern is split at each / and each component compiled
+		 (see compileComponent), then matched a directory at a time from the
+		 start of the word (see expandFrom). Everything is allocated in the
+		 parser's arena
+ ** Input(s): 	 The arena, the word, and where to return the matches
+ ** Output(s): 	 No output
+ ** Returns: 	 The number of matches, which are sorted, 0 if there are none (the
+		 word is then kept as it is), or -1 if memory cannot be allocated
+ ** *******************************************************************************/
+int globExpand(struct arena* arena, const char* word, char*** matches)
+{
+	struct globState* state = arenaAlloc(arena, sizeof(struct globState));
+	if (state == NULL)
+	{
+		return -1;
+	}
+	state->arena = arena;
+	state->matches = NULL;
+	state->numMatches = 0;
+	state->numComponents = 0;
+	state->trailingSlash = 0;
+
+	// an absolute pattern starts from /, which is the first component. Repeated /s are
+	// the same as one
+	const char* c = word;
+	size_t length = 0;
+	if (*c == '/')
+	{
+		state->path[length++] = '/';
+		while (*c == '/') c++;
+	}
+	state->path[length] = '\0';
+
+	int numComponents = 0;
+	const char* scan;
+	for (scan = c; *scan != '\0'; scan++)
+	{
+		if (*scan != '/' && (scan == c || scan[-1] == '/')) numComponents++;
+	}
+	state->components = arenaAlloc(arena, (numComponents + 1) * sizeof(struct globPattern));
+	if (state->components == NULL)
+	{
+		return -1;
+	}
+	while (*c != '\0')
+	{
+		const char* end = strchr(c, '/');
+		if (end == NULL) end = c + strlen(c);
+		if (compileComponent(arena, c, end - c, &state->components[state->numComponents++]) == -1)
+		{
+			return -1;
+		}
+		while (*end == '/') end++;
+		if (*end == '\0' && end[-1] == '/') state->trailingSlash = 1;
+		c = end;
+	}
+
+	// a pattern of only /s has nothing to match
+	if (state->numComponents == 0 || expandFrom(state, 0, length, 0) == -1)
+	{
+		return state->numComponents == 0 ? 0 : -1;
+	}
+	if (state->numMatches == 0)
+	{
+		return 0;
+	}
+
+	*matches = arenaAlloc(arena, state->numMatches * sizeof(char*));
+	if (*matches == NULL)
+	{
+		return -1;
+	}
+	struct globMatch* match = state->matches;
+	int i;
+	for (i = 0; i < state->numMatches; i++, match = match->next)
+	{
+		(*matches)[i] = match->path;
+	}
+	qsort(*matches, state->numMatches, sizeof(char*), compareMatches);
+	return state->numMatches;
+}
@@ -0,0 +1,523 @@
+/* **********************************************************************************
+ ** Program Name:   Program 3 - smallsh (history_smallsh.c)
+ ** Author:         Susan Hibbert
+ ** Date:           20th May 2020
+ ** Description:    Command history for the smallsh program. Lines entered at the
+		    prompt are appended to a log file ($HISTFILE, or ~/.smallsh_history),
+		    and the offset of each one is appended to an index file beside it
+		    (the same name ending in .idx). Both files are mapped into memory at
+		    startup, so loading the history takes the same time however long it
+		    is - entry n is found by looking up its offset in the index, and
+		    nothing is read until it is used.
+
+		    !! is the last command, !n command n, !-n the command n back and
+		    !prefix the last command beginning with prefix. Searching by prefix
+		    uses the entries sorted by their text (built the first time it is
+		    needed) and a tree holding the newest entry in each range of the
+		    sorted entries, so each search takes O(log n) time
+ ** *******************************************************************************/
+#include "smallsh.h"
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/file.h>
+
+#define MAX_UNINDEXED 1024	// entries added before the search index is rebuilt
+
+static struct
+{
+	int logFD;			// the log of commands, one to a line, -1 if there is none
+	int indexFD;			// offset of each command in the log
+	const char* log;		// the log, mapped into memory
+	size_t logMapped;		// bytes of the log mapped
+	const uint64_t* offsets;	// the index, mapped into memory
+	size_t entriesMapped;		// entries in the index mapped
+	size_t entries;			// entries in the history
+	uint64_t logSize;		// bytes in the log
+
+	int* sorted;			// entry numbers, sorted by the entries' text
+	int* newest;			// tree of the newest entry in each range of sorted
+	size_t indexed;			// entries in the search index
+
+	char* expanded;			// the line after history expansion
+	size_t expandedSize;
+} history = { .logFD = -1, .indexFD = -1 };
+
+
+// Maps the log and index into memory again, to take in the entries added since they were
+// last mapped
+static void historyMap()
+{
+	if (history.log != NULL) munmap((void*)history.log, history.logMapped);
+	if (history.offsets != NULL) munmap((void*)history.offsets, history.entriesMapped * sizeof(uint64_t));
+	history.log = NULL;
+	history.offsets = NULL;
+	history.logMapped = 0;
+	history.entriesMapped = 0;
+
+	if (history.logSize > 0 && history.entries > 0)
+	{
+		void* log = mmap(NULL, history.logSize, PROT_READ, MAP_SHARED, history.logFD, 0);
+		void* offsets = mmap(NULL, history.entries * sizeof(uint64_t), PROT_READ, MAP_SHARED, history.indexFD, 0);
+		if (log != MAP_FAILED && offsets != MAP_FAILED)
+		{
+			history.log = log;
+			history.logMapped = history.logSize;
+			history.offsets = offsets;
+			history.entriesMapped = history.entries;
+		}
+		else
+		{
+			if (log != MAP_FAILED) munmap(log, history.logSize);
+			if (offsets != MAP_FAILED) munmap(offsets, history.entries * sizeof(uint64_t));
+		}
+	}
+}
+
+
+/* **********************************************************************************
+ ** Description: Opens the history log and its index, creating them if they do not
+		 exist, and maps them into memory. Only the sizes of the files are
+		 read
+ ** Input(s): 	 No input
+ ** Output(s): 	 No output - without a history file the shell runs without history
+ ** Returns: 	 No return value
+ ** *******************************************************************************/
+void historyInit()
+{
+	char logName[PATH_MAX];
+	char indexName[PATH_MAX + 4];
+	struct stat logInfo, indexInfo;
+
+	const char* name = getenv("HISTFILE");
+	const char* home = getenv("HOME");
+	if (name != NULL && name[0] != '\0')
+	{
+		snprintf(logName, sizeof(logName), "%s", name);
+	}
+	else if (home != NULL)
+	{
+		snprintf(logName, sizeof(logName), "%s/.smallsh_history", home);
+	}
+	else
+	{
+		return;
+	}
+	snprintf(indexName, sizeof(indexName), "%s.idx", logName);
+
+	history.logFD = open(logName, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+	history.indexFD = open(indexName, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+	if (history.logFD == -1 || history.indexFD == -1 ||
+	    fstat(history.logFD, &logInfo) == -1 || fstat(history.indexFD, &indexInfo) == -1)
+	{
+		if (history.logFD != -1) close(history.logFD);
+		if (history.indexFD != -1) close(history.indexFD);
+		history.logFD = -1;
+		history.indexFD = -1;
+		return;
+	}
+
+	// an entry only counts once its offset is in the index
+	history.logSize = logInfo.st_size;
+	history.entries = indexInfo.st_size / sizeof(uint64_t);
+	historyMap();
+}
+
+
+// Returns the text of entry n (numbered from 0), setting its length. The text is not
+// '\0' terminated
+static const char* entryText(size_t n, size_t* length)
+{
+	if (n >= history.entriesMapped)
+	{
+		historyMap();
+	}
+
+	uint64_t start = n < history.entriesMapped ? history.offsets[n] : history.logMapped;
+	if (start >= history.logMapped)
+	{
+		*length = 0;
+		return "";
+	}
+	const char* newline = memchr(history.log + start, '\n', history.logMapped - start);
+	*length = newline != NULL ? (size_t)(newline - (history.log + start)) : history.logMapped - start;
+	return history.log + start;
+}
+
+
+/* **********************************************************************************
+ ** Description: Locks the history files against other shells, then takes in their
+		 current sizes, mapping them again if they have changed. Another shell
+		 may have added to them or cleared them (history -c), and nothing past
+		 the end of either file may be read, so every use of the history is
+		 made between historyLock and historyUnlock
+ ** Input(s): 	 The kind of lock - LOCK_SH to read the history, LOCK_EX to change it
+ ** Output(s): 	 No output
+ ** Returns: 	 No return value
+ ** *******************************************************************************/
+static void historyLock(int operation)
+{
+	struct stat logInfo, indexInfo;
+
+	if (history.logFD == -1)
+	{
+		return;
+	}
+	flock(history.logFD, operation);
+	if (fstat(history.logFD, &logInfo) == -1 || fstat(history.indexFD, &indexInfo) == -1)
+	{
+		logInfo.st_size = 0;
+		indexInfo.st_size = 0;
+	}
+
+	size_t entries = indexInfo.st_size / sizeof(uint64_t);
+	if ((uint64_t)logInfo.st_size != history.logSize || entries != history.entries)
+	{
+		// a history that has shrunk has been cleared, and its search index is rebuilt
+		if ((uint64_t)logInfo.st_size < history.logSize || entries < history.indexed)
+		{
+			history.indexed = 0;
+		}
+		history.logSize = logInfo.st_size;
+		history.entries = entries;
+		historyMap();
+	}
+}
+
+
+// Unlocks the history files
+static void historyUnlock()
+{
+	if (history.logFD != -1)
+	{
+		flock(history.logFD, LOCK_UN);
+	}
+}
+
+
+/* **********************************************************************************
+ ** Description: Adds a line to the end of the history - the line goes on the end of
+		 the log, then its offset on the end of the index. Other shells may
+		 share the files, so it is called with the log locked (see
+		 historyLock), and the offset is taken from the size of the log at
+		 the time. If either write
+		 fails, the files are cut back to where they were, so that every line
+		 in the log has its entry in the index
+ ** Input(s): 	 The line and its length, without a newline
+ ** Output(s): 	 No output
+ ** Returns: 	 No return value
+ ** *******************************************************************************/
+static void historyAdd(const char* line, size_t length)
+{
+	struct iovec parts[2] = { { (void*)line, length }, { "\n", 1 } };
+	struct stat logInfo, indexInfo;
+
+	if (history.logFD == -1)
+	{
+		return;
+	}
+	if (fstat(history.logFD, &logInfo) == 0 && fstat(history.indexFD, &indexInfo) == 0)
+	{
+		uint64_t offset = logInfo.st_size;
+		off_t indexSize = indexInfo.st_size - indexInfo.st_size % sizeof(uint64_t);
+
+		// a torn entry left at the end of the index is dropped before the new one is added
+		if (indexSize != indexInfo.st_size)
+		{
+			ftruncate(history.indexFD, indexSize);
+		}
+		if (writev(history.logFD, parts, 2) == (ssize_t)(length + 1) &&
+		    write(history.indexFD, &offset, sizeof(offset)) == sizeof(offset))
+		{
+			// this takes in any lines other shells have added too
+			history.logSize = offset + length + 1;
+			history.entries = indexSize / sizeof(uint64_t) + 1;
+		}
+		else
+		{
+			ftruncate(history.logFD, offset);
+			ftruncate(history.indexFD, indexSize);
+		}
+	}
+}
+
+
+// Compares the text of an entry with a prefix, looking no further than the length of the
+// prefix. Returns less than, equal to or greater than 0, as strncmp does
+static int comparePrefix(size_t n, const char* prefix, size_t prefixLength)
+{
+	size_t length;
+	const char* text = entryText(n, &length);
+	int result = memcmp(text, prefix, length < prefixLength ? length : prefixLength);
+	if (result == 0 && length < prefixLength)
+	{
+		return -1;
+	}
+	return result;
+}
+
+
+// Compares the text of two entries, for sorting the search index - entries with the same
+// text are kept in order of entry number
+static int compareEntries(const void* a, const void* b)
+{
+	size_t lengthA, lengthB;
+	const char* textA = entryText(*(const int*)a, &lengthA);
+	const char* textB = entryText(*(const int*)b, &lengthB);
+	int result = memcmp(textA, textB, lengthA < lengthB ? lengthA : lengthB);
+	if (result == 0 && lengthA != lengthB)
+	{
+		result = lengthA < lengthB ? -1 : 1;
+	}
+	return result != 0 ? result : *(const int*)a - *(const int*)b;
+}
+
+
+/* **********************************************************************************
+ ** Description: Builds the search index - every entry, sorted by text, and a tree in
+		 which leaf i holds sorted entry i and each node holds the newest
+		 (highest numbered) entry below it
+ ** Input(s): 	 No input
+ ** Output(s): 	 No output
+ ** Returns: 	 No return value
+ ** *******************************************************************************/
+static void buildSearchIndex()
+{
+	size_t n = history.entries;
+	size_t i;
+
+	if (n == 0)
+	{
+		return;
+	}
+	historyMap();
+	history.sorted = realloc(history.sorted, n * sizeof(int));
+	history.newest = realloc(history.newest, 2 * n * sizeof(int));
+	for (i = 0; i < n; i++)
+	{
+		history.sorted[i] = i;
+	}
+	qsort(history.sorted, n, sizeof(int), compareEntries);
+
+	// the leaves are at n..2n-1, and the parent of node i is i / 2
+	memcpy(history.newest + n, history.sorted, n * sizeof(int));
+	for (i = n - 1; i >= 1; i--)
+	{
+		int left = history.newest[2 * i];
+		int right = history.newest[2 * i + 1];
+		history.newest[i] = left > right ? left : right;
+	}
+	history.indexed = n;
+}
+
+
+/* **********************************************************************************
+ ** Description: Finds the newest entry beginning with a prefix. Entries added since
+		 the search index was built are checked newest first, then the sorted
+		 entries beginning with the prefix are found by binary search, and the
+		 newest of them by climbing the tree
+ ** Input(s): 	 The prefix and its length
+ ** Output(s): 	 No output
+ ** Returns: 	 The entry number, or -1 if no entry begins with the prefix
+ ** *******************************************************************************/
+static long searchPrefix(const char* prefix, size_t prefixLength)
+{
+	size_t i;
+
+	if (history.entries - history.indexed > MAX_UNINDEXED)
+	{
+		buildSearchIndex();
+	}
+	for (i = history.entries; i > history.indexed; i--)
+	{
+		if (comparePrefix(i - 1, prefix, prefixLength) == 0)
+		{
+			return i - 1;
+		}
+	}
+
+	// the sorted entries from first up to last begin with the prefix
+	size_t n = history.indexed;
+	size_t low = 0, high = n;
+	while (low < high)
+	{
+		size_t middle = (low + high) / 2;
+		if (comparePrefix(history.sorted[middle], prefix, prefixLength) < 0) low = middle + 1;
+		else high = middle;
+	}
+	size_t first = low;
+	high = n;
+	while (low < high)
+	{
+		size_t middle = (low + high) / 2;
+		if (comparePrefix(history.sorted[middle], prefix, prefixLength) <= 0) low = middle + 1;
+		else high = middle;
+	}
+	size_t last = low;
+
+	// the newest entry of the leaves first..last-1, taken from the nodes that cover them
+	long newest = -1;
+	for (first += n, last += n; first < last; first /= 2, last /= 2)
+	{
+		if (first & 1)
+		{
+			if (history.newest[first] > newest) newest = history.newest[first];
+			first++;
+		}
+		if (last & 1)
+		{
+			last--;
+			if (history.newest[last] > newest) newest = history.newest[last];
+		}
+	}
+	return newest;
+}
+
+
+// Adds text to the expanded line, making room for it
+static void appendExpanded(size_t* length, const char* text, size_t textLength)
+{
+	if (*length + textLength + 1 > history.expandedSize)
+	{
+		history.expandedSize = (*length + textLength + 1) * 2;
+		history.expanded = realloc(history.expanded, history.expandedSize);
+	}
+	memcpy(history.expanded + *length, text, textLength);
+	*length += textLength;
+	history.expanded[*length] = '\0';
+}
+
+
+/* **********************************************************************************
+ ** Description: Replaces each history reference in a line entered at the prompt -
+		 !! for the last command, !n for command n, !-n for the command n
+		 back, and !prefix for the last command beginning with prefix. A !
+		 followed by a space, =, or the end of the line, or after a $ (as in
+		 $!), is left alone. The line is then added to the history
+ ** Input(s): 	 The line entered
+ ** Output(s): 	 The line after expansion, if it changed, or an error message if a
+		 command is not in the history
+ ** Returns: 	 The line to run, or NULL if a command is not in the history. The line
+		 is overwritten by the next call
+ ** *******************************************************************************/
+char* historyExpand(const char* line)
+{
+	size_t length = 0;
+	int changed = 0;
+	const char* c = line;
+
+	// the history is locked while it is read and the line is added to it
+	historyLock(LOCK_EX);
+	appendExpanded(&length, "", 0);
+	while (*c != '\0')
+	{
+		const char* start = c;
+		if (c[0] != '!' || c[1] == '\0' || c[1] == ' ' || c[1] == '\t' || c[1] == '\n' || c[1] == '=' ||
+		    (c > line && c[-1] == '$'))
+		{
+			appendExpanded(&length, c, 1);
+			c++;
+			continue;
+		}
+
+		// work out which entry is meant
+		long n;
+		c++;
+		if (*c == '!')
+		{
+			n = history.entries - 1;
+			c++;
+		}
+		else if ((*c >= '0' && *c <= '9') || (*c == '-' && c[1] >= '0' && c[1] <= '9'))
+		{
+			char* end;
+			n = strtol(c, &end, 10);
+			n = n < 0 ? (long)history.entries + n : n - 1;
+			c = end;
+		}
+		else
+		{
+			const char* prefix = c;
+			while (*c != '\0' && *c != ' ' && *c != '\t' && *c != '\n')
+			{
+				c++;
+			}
+			n = searchPrefix(prefix, c - prefix);
+		}
+
+		if (n < 0 || (size_t)n >= history.entries)
+		{
+			historyUnlock();
+			fprintf(stderr, "smallsh: %.*s: event not found\n", (int)(c - start), start);
+			return NULL;
+		}
+		size_t textLength;
+		const char* text = entryText(n, &textLength);
+		appendExpanded(&length, text, textLength);
+		changed = 1;
+	}
+
+	// the line is shown again once it has changed, and kept without its newline
+	if (changed == 1)
+	{
+		printf("%s", history.expanded);
+		if (length == 0 || history.expanded[length - 1] != '\n') printf("\n");
+		fflush(stdout);		// flush output buffers after printing
+	}
+	size_t textLength = length;
+	while (textLength > 0 && (history.expanded[textLength - 1] == '\n' || history.expanded[textLength - 1] == ' '))
+	{
+		textLength--;
+	}
+	if (textLength > 0)
+	{
+		historyAdd(history.expanded, textLength);
+	}
+	historyUnlock();
+	return history.expanded;
+}
+
+
+// Built-in command history [n] - lists the last n commands (or all of them) with their
+// numbers. history -c clears the history
+int historyBuiltin(struct command* command, int* childExitMethod)
+{
+	size_t i;
+
+	// other shells sharing the files only read them with the lock held, after taking in
+	// their new sizes, so they never touch the pages cut off here
+	if (command->argc > 1 && strcmp(command->argv[1], "-c") == 0)
+	{
+		historyLock(LOCK_EX);
+		if (history.logFD != -1)
+		{
+			ftruncate(history.logFD, 0);
+			ftruncate(history.indexFD, 0);
+		}
+		history.entries = 0;
+		history.logSize = 0;
+		history.indexed = 0;
+		historyMap();
+		historyUnlock();
+		*childExitMethod = EXIT_METHOD(0);
+		return 0;
+	}
+
+	historyLock(LOCK_SH);
+	size_t count = history.entries;
+	if (command->argc > 1 && (size_t)atol(command->argv[1]) < count)
+	{
+		count = atol(command->argv[1]);
+	}
+
+	for (i = history.entries - count; i < history.entries; i++)
+	{
+		size_t length;
+		const char* text = entryText(i, &length);
+		printf("%5zu  %.*s\n", i + 1, (int)length, text);
+	}
+	historyUnlock();
+	*childExitMethod = EXIT_METHOD(0);
+	return 0;
+}
@@ -0,0 +1,180 @@
+/* **********************************************************************************
+ ** Program Name:   Program 3 - smallsh (input_smallsh.c)
+ ** Author:         Susan Hibbert
+ ** Date:           20th May 2020
+ ** Description:    Where smallsh reads its command lines from - the user at the
+		    prompt, a script file, or the string given with -c. A script file
+		    is mapped into memory in one go, and lines are taken from it
+		    without any further system calls. At the prompt, stdin is read
+		    with read() once the event loop reports it readable, so the shell
+		    goes on handling signals while it waits for a line
+ ** *******************************************************************************/
+#include "smallsh.h"
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <errno.h>
+
+
+/* **********************************************************************************
+ ** Description: Sets up input to be read from the user at the prompt (stdin)
+ ** Input(s): 	 The input to set up
+ ** Output(s): 	 No output
+ ** Returns: 	 No return value
+ ** *******************************************************************************/
+void inputFromStdin(struct input* input)
+{
+	memset(input, 0, sizeof(struct input));
+	input->interactive = 1;
+}
+
+
+// Sets up input to be read from a string (for smallsh -c)
+void inputFromString(struct input* input, const char* commands)
+{
+	memset(input, 0, sizeof(struct input));
+	input->data = commands;
+	input->length = strlen(commands);
+}
+
+
+/* **********************************************************************************
+ ** Description: Sets up input to be read from a script file. The file is mapped into
+		 memory (or read into memory, for files such as pipes that cannot be
+		 mapped)
+ ** Input(s): 	 The input to set up, and the name of the script
+ ** Output(s): 	 Displays an error message if the script cannot be read
+ ** Returns: 	 Returns 0, or -1 if the script cannot be read
+ ** *******************************************************************************/
+int inputFromFile(struct input* input, const char* fileName)
+{
+	struct stat fileInfo;
+
+	memset(input, 0, sizeof(struct input));
+	int fd = open(fileName, O_RDONLY | O_CLOEXEC);
+	if (fd == -1 || fstat(fd, &fileInfo) == -1)
+	{
+		perror(fileName);
+		if (fd != -1) close(fd);
+		return -1;
+	}
+
+	if (S_ISREG(fileInfo.st_mode) && fileInfo.st_size > 0)
+	{
+		void* data = mmap(NULL, fileInfo.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data != MAP_FAILED)
+		{
+			madvise(data, fileInfo.st_size, MADV_SEQUENTIAL);
+			input->data = data;
+			input->length = fileInfo.st_size;
+			close(fd);
+			return 0;
+		}
+	}
+
+	// read the whole script into memory instead
+	size_t size = 0;
+	char* data = NULL;
+	ssize_t charsRead = 1;
+	while (charsRead > 0)
+	{
+		if (input->length == size)
+		{
+			size = size == 0 ? 65536 : size * 2;
+			data = realloc(data, size);
+		}
+		charsRead = read(fd, data + input->length, size - input->length);
+		if (charsRead > 0)
+		{
+			input->length += charsRead;
+		}
+	}
+	close(fd);
+	if (charsRead == -1)
+	{
+		perror(fileName);
+		free(data);
+		return -1;
+	}
+	input->data = data;
+	return 0;
+}
+
+
+/* **********************************************************************************
+ ** Description: Reads more of stdin into the input's buffer, once the event loop
+		 reports that it is readable. The lines already taken from the buffer
+		 are dropped first, and the buffer is doubled in size when it is full
+ ** Input(s): 	 The input
+ ** Output(s): 	 No output
+ ** Returns: 	 No return value. atEnd is set at end of file, or if stdin cannot be
+		 read
+ ** *******************************************************************************/
+static void fillBuffer(struct input* input)
+{
+	memmove(input->buffer, input->buffer + input->pos, input->length - input->pos);
+	input->length -= input->pos;
+	input->pos = 0;
+	if (input->length == input->bufferSize)
+	{
+		input->bufferSize = input->bufferSize == 0 ? 4096 : input->bufferSize * 2;
+		input->buffer = realloc(input->buffer, input->bufferSize);
+	}
+	input->data = input->buffer;
+
+	if (eventsWait(1) == -1)
+	{
+		input->atEnd = 1;
+		return;
+	}
+	ssize_t charsRead = read(STDIN_FILENO, input->buffer + input->length, input->bufferSize - input->length);
+	if (charsRead > 0)
+	{
+		input->length += charsRead;
+	}
+	else if (charsRead == 0 || (errno != EAGAIN && errno != EINTR))
+	{
+		input->atEnd = 1;
+	}
+}
+
+
+/* **********************************************************************************
+ ** Description: Reads the next command line. At the prompt, stdin is read until the
+		 buffer holds a whole line (see fillBuffer). The line is then copied
+		 out of the buffer, or out of the script held in memory, so that it
+		 can be given to the parser as a string
+ ** Input(s): 	 The input
+ ** Output(s): 	 No output
+ ** Returns: 	 The line, including its newline if it had one, or NULL at the end of
+		 the input. The line is overwritten by the next call
+ ** *******************************************************************************/
+char* inputReadLine(struct input* input, int* lineLength)
+{
+	while (input->interactive == 1 && input->atEnd == 0 &&
+	       (input->pos == input->length || memchr(input->data + input->pos, '\n', input->length - input->pos) == NULL))
+	{
+		fillBuffer(input);
+	}
+
+	if (input->pos >= input->length)
+	{
+		return NULL;
+	}
+
+	// the line runs up to and including the next newline, or to the end of the input
+	const char* start = input->data + input->pos;
+	const char* newline = memchr(start, '\n', input->length - input->pos);
+	size_t length = newline != NULL ? (size_t)(newline - start) + 1 : input->length - input->pos;
+	input->pos += length;
+
+	if (length + 1 > input->lineSize)
+	{
+		input->lineSize = length + 1 > 256 ? length + 1 : 256;
+		free(input->line);
+		input->line = malloc(input->lineSize);
+	}
+	memcpy(input->line, start, length);
+	input->line[length] = '\0';
+	*lineLength = length;
+	return input->line;
+}
@@ -0,0 +1,720 @@
+/* **********************************************************************************
+ ** Program Name:   Program 3 - smallsh (jobs_smallsh.c)
+ ** Author:         Susan Hibbert
+ ** Date:           20th May 2020
+ ** Description:    Job table for the smallsh program. Every pipeline the shell runs is
+		    a job with a job ID, and stays in the table for as long as any of
+		    its processes are running or stopped. Children are reaped as they
+		    finish: each SIGCHLD is read from the event loop's signalfd (see
+		    events_smallsh.c), and the shell reaps whichever children have
+		    changed state, so the cost depends only on the number of children
+		    that have finished. Children are reaped with wait4, so the
+		    resources each job used are added up as its processes finish.
+		    At the prompt on a terminal, the shell has job control: it leads a
+		    process group of its own, and hands the terminal to each
+		    foreground job with tcsetpgrp, taking it back when the job
+		    finishes or is stopped with CTRL-Z. Also holds the jobs, fg, bg,
+		    wait and disown built-in commands
+ ** *******************************************************************************/
+#include "smallsh.h"
+#include <errno.h>
+
+#define PID_BUCKETS 256		// number of buckets in the pid hash table
+#define SHUTDOWN_GRACE 1	// seconds jobs are given to finish after SIGHUP and SIGTERM
+
+// a process belonging to a job
+struct process
+{
+	pid_t pid;
+	int stopped;			// bool - the process is stopped
+	struct job* job;		// job the process belongs to
+	struct process* nextInJob;	// next process of the same job
+	struct process* nextInBucket;	// next process in the same pid hash bucket
+};
+
+static struct job* firstJob = NULL;			// jobs, in order of job ID
+static struct process* pidTable[PID_BUCKETS];		// running processes, hashed by pid
+static int finishedJobs = 0;				// background jobs finished since the last notice
+
+// process group of the pipeline running in the foreground, 0 if there is none
+pid_t foregroundPgid = 0;
+
+// the terminal, when the shell has job control, otherwise -1
+int terminalFD = -1;
+static pid_t shellPgid = 0;			// the shell's own process group
+static struct termios shellModes;		// terminal modes at the prompt
+
+// process group of the job last run in the background, for $!
+pid_t lastBackgroundPid = 0;
+
+// resources used by the last foreground job, for status -v and time
+struct usage lastUsage;
+
+
+/* **********************************************************************************
+ ** Description: Sets up job control, if stdin is a terminal. A shell started in the
+		 background waits until it is brought to the foreground. The shell
+		 then leads a process group of its own and takes the terminal.
+		 SIGTTOU is blocked, so the shell can take the terminal back from a
+		 job while it is in the background itself
+ ** Input(s): 	 No input
+ ** Output(s): 	 No output
+ ** Returns: 	 No return value
+ ** *******************************************************************************/
+void jobControlInit()
+{
+	if (isatty(STDIN_FILENO) == 0)
+	{
+		return;
+	}
+	while (tcgetpgrp(STDIN_FILENO) != getpgrp())
+	{
+		kill(-getpgrp(), SIGTTIN);
+	}
+
+	sigset_t terminalSignals;
+	sigemptyset(&terminalSignals);
+	sigaddset(&terminalSignals, SIGTTOU);
+	sigaddset(&terminalSignals, SIGTTIN);
+	sigprocmask(SIG_BLOCK, &terminalSignals, NULL);
+
+	// the shell's own redirections change stdin, so the terminal is kept on a file
+	// descriptor of its own
+	setpgid(0, 0);
+	shellPgid = getpgrp();
+	int fd = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, MAX_REDIRECT_FD + 1);
+	if (fd == -1 || tcsetpgrp(fd, shellPgid) == -1 || tcgetattr(fd, &shellModes) == -1)
+	{
+		if (fd != -1) close(fd);
+		return;
+	}
+	terminalFD = fd;
+}
+
+
+/* **********************************************************************************
+ ** Description: Adds a new job to the table, with the next free job ID (one more
+		 than the highest job ID in use)
+ ** Input(s): 	 The command line the job runs, and bool - whether it runs in the
+		 background
+ ** Output(s): 	 No output
+ ** Returns: 	 The new job
+ ** *******************************************************************************/
+struct job* jobCreate(const char* text, int background)
+{
+	struct job* job = calloc(1, sizeof(struct job));
+	struct job** link = &firstJob;
+	int id = 1;
+
+	while (*link != NULL)
+	{
+		id = (*link)->id + 1;
+		link = &(*link)->next;
+	}
+	*link = job;
+
+	// the command line is kept without its trailing newline
+	int length = strlen(text);
+	while (length > 0 && (text[length - 1] == '\n' || text[length - 1] == ' '))
+	{
+		length--;
+	}
+	job->text = strndup(text, length);
+	clock_gettime(CLOCK_MONOTONIC, &job->started);
+	job->id = id;
+	job->background = background;
+	return job;
+}
+
+
+// Adds a process that has just been started to a job. The first process of a job leads
+// its process group
+void jobAddProcess(struct job* job, pid_t pid)
+{
+	struct process* process = calloc(1, sizeof(struct process));
+	struct process** bucket = &pidTable[pid % PID_BUCKETS];
+
+	process->pid = pid;
+	process->job = job;
+	process->nextInJob = job->processes;
+	job->processes = process;
+	process->nextInBucket = *bucket;
+	*bucket = process;
+
+	if (job->pgid == 0)
+	{
+		job->pgid = pid;
+	}
+	job->lastPid = pid;
+	job->remaining++;
+}
+
+
+// Continues a stopped job. Its processes are counted as running straight away, so a wait
+// for the job does not return before SIGCONT has been delivered
+void continueJob(struct job* job)
+{
+	struct process* process;
+	for (process = job->processes; process != NULL; process = process->nextInJob)
+	{
+		process->stopped = 0;
+	}
+	job->stopped = 0;
+	kill(-job->pgid, SIGCONT);
+}
+
+
+// Removes a job from the table and frees it. Any of its processes still running are
+// forgotten about
+void jobRemove(struct job* job)
+{
+	struct job** link = &firstJob;
+	while (*link != job)
+	{
+		link = &(*link)->next;
+	}
+	*link = job->next;
+
+	while (job->processes != NULL)
+	{
+		struct process* process = job->processes;
+		struct process** bucket = &pidTable[process->pid % PID_BUCKETS];
+		while (*bucket != process)
+		{
+			bucket = &(*bucket)->nextInBucket;
+		}
+		*bucket = process->nextInBucket;
+		job->processes = process->nextInJob;
+		free(process);
+	}
+	cgroupRemoveJob(job);
+
+	// a profiled job's counts are reported once it has finished
+	if (job->profile != NULL)
+	{
+		if (job->remaining == 0) profileReport(job->profile);
+		profileClose(job->profile);
+	}
+	free(job->text);
+	free(job);
+}
+
+
+// Adds a second time to the first
+static void addTime(struct timeval* total, const struct timeval* more)
+{
+	total->tv_sec += more->tv_sec;
+	total->tv_usec += more->tv_usec;
+	if (total->tv_usec >= 1000000)
+	{
+		total->tv_sec++;
+		total->tv_usec -= 1000000;
+	}
+}
+
+
+/* **********************************************************************************
+ ** Description: Records a change of state of a child reported by wait4. A child that
+		 has finished is removed from its job, its resource usage is added to
+		 the job's, and the exit method of the job's last command is kept for
+		 status
+ ** Input(s): 	 The child's pid, its status and its resource usage from wait4
+ ** Output(s): 	 No output
+ ** Returns: 	 No return value
+ ** *******************************************************************************/
+static void recordStatus(pid_t pid, int exitMethod, struct rusage* rusage)
+{
+	struct process** link = &pidTable[pid % PID_BUCKETS];
+	while (*link != NULL && (*link)->pid != pid)
+	{
+		link = &(*link)->nextInBucket;
+	}
+
+	// children the shell is not tracking (such as the kill run by exit) are ignored
+	struct process* process = *link;
+	if (process == NULL)
+	{
+		return;
+	}
+	struct job* job = process->job;
+
+	if (WIFSTOPPED(exitMethod))
+	{
+		if (process->stopped == 0) job->stopped++;
+		process->stopped = 1;
+		return;
+	}
+	if (WIFCONTINUED(exitMethod))
+	{
+		if (process->stopped == 1) job->stopped--;
+		process->stopped = 0;
+		return;
+	}
+
+	// the child has finished - take it out of the pid table and its job
+	*link = process->nextInBucket;
+	struct process** inJob = &job->processes;
+	while (*inJob != process)
+	{
+		inJob = &(*inJob)->nextInJob;
+	}
+	*inJob = process->nextInJob;
+	if (process->stopped == 1) job->stopped--;
+	free(process);
+
+	struct rusage* total = &job->usage.rusage;
+	addTime(&total->ru_utime, &rusage->ru_utime);
+	addTime(&total->ru_stime, &rusage->ru_stime);
+	total->ru_maxrss = rusage->ru_maxrss > total->ru_maxrss ? rusage->ru_maxrss : total->ru_maxrss;
+	total->ru_minflt += rusage->ru_minflt;
+	total->ru_majflt += rusage->ru_majflt;
+	total->ru_nvcsw += rusage->ru_nvcsw;
+	total->ru_nivcsw += rusage->ru_nivcsw;
+
+	job->remaining--;
+	if (pid == job->lastPid)
+	{
+		job->exitMethod = exitMethod;
+	}
+	if (job->remaining == 0)
+	{
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		job->usage.wall = (now.tv_sec - job->started.tv_sec) + (now.tv_nsec - job->started.tv_nsec) / 1e9;
+	}
+	if (job->remaining == 0 && (job->background == 1 || job->quiet == 1))
+	{
+		finishedJobs++;
+	}
+}
+
+
+/* **********************************************************************************
+ ** Description: Waits until none of a job's processes are running, because they have
+		 all finished or stopped. Other children that finish meanwhile are
+		 recorded too. CTRL-C is passed on to the job while the shell waits.
+		 With job control, a foreground job has the terminal while the shell
+		 waits, with the terminal modes it had when it was stopped, and a
+		 stopped foreground job is continued once it has the terminal
+ ** Input(s): 	 The job
+ ** Output(s): 	 No output
+ ** Returns: 	 No return value
+ ** *******************************************************************************/
+void waitJob(struct job* job)
+{
+	int foreground = terminalFD != -1 && job->background == 0;
+	if (foreground == 1)
+	{
+		if (job->savedModes == 1)
+		{
+			tcsetattr(terminalFD, TCSADRAIN, &job->modes);
+		}
+		tcsetpgrp(terminalFD, job->pgid);
+	}
+	if (job->background == 0 && job->stopped > 0)
+	{
+		continueJob(job);
+	}
+
+	foregroundPgid = job->pgid;
+	while (job->remaining > job->stopped && eventsWait(0) == 0);
+	foregroundPgid = 0;
+
+	// the shell takes the terminal back, keeping the modes of a job that was stopped
+	if (foreground == 1)
+	{
+		tcsetpgrp(terminalFD, shellPgid);
+		if (job->remaining > 0)
+		{
+			job->savedModes = tcgetattr(terminalFD, &job->modes) == 0;
+		}
+		tcsetattr(terminalFD, TCSADRAIN, &shellModes);
+	}
+}
+
+
+// Records every child which has changed state, without blocking. Returns 0, or -1 if the
+// shell has no children
+int reapChildren()
+{
+	struct rusage rusage;
+	int exitMethod;
+	pid_t pid;
+
+	while ((pid = wait4(-1, &exitMethod, WNOHANG | WUNTRACED | WCONTINUED, &rusage)) > 0)
+	{
+		recordStatus(pid, exitMethod, &rusage);
+	}
+	return pid == -1 && errno == ECHILD ? -1 : 0;
+}
+
+
+// Blocks until the next child finishes or stops, and records it, for a copy of the shell
+// (such as parallel) whose signals are not blocked. Returns 0, or -1 if it has no children
+// left
+int waitChild()
+{
+	struct rusage rusage;
+	int exitMethod;
+	pid_t pid;
+
+	while ((pid = wait4(-1, &exitMethod, WUNTRACED, &rusage)) == -1)
+	{
+		if (errno != EINTR) return -1;
+	}
+	recordStatus(pid, exitMethod, &rusage);
+	return 0;
+}
+
+
+/* **********************************************************************************
+ ** Description: Reaps any children which have changed state since SIGCHLD
+		 was last read, then prints a message for each background job that has
+		 finished and removes it from the table. Finished process
+		 substitutions are removed without a message. Called before each
+		 prompt
+ ** Input(s): 	 No input
+ ** Output(s): 	 A message for each background job that has finished
+ ** Returns: 	 No return value
+ ** *******************************************************************************/
+void notifyJobs()
+{
+	eventsPoll();
+
+	// the table is only searched when a background job has finished (it may have been
+	// reaped while the shell waited for a foreground job)
+	if (finishedJobs == 0)
+	{
+		return;
+	}
+	finishedJobs = 0;
+
+	struct job* job = firstJob;
+	while (job != NULL)
+	{
+		struct job* next = job->next;
+		if (job->remaining == 0 && job->quiet == 1)
+		{
+			jobRemove(job);
+		}
+		else if (job->remaining == 0 && job->background == 1)
+		{
+			// print out the exit status
+			if (WIFEXITED(job->exitMethod) != 0)
+			{
+				printf("background pid %d is done: exit value %d (%.3f seconds)\n", job->pgid,
+				       WEXITSTATUS(job->exitMethod), job->usage.wall);
+			}
+			// print out the terminating signal
+			else if (WIFSIGNALED(job->exitMethod) != 0)
+			{
+				printf("background pid %d is done: terminated by signal %d (%.3f seconds)\n", job->pgid,
+				       WTERMSIG(job->exitMethod), job->usage.wall);
+			}
+			fflush(stdout);		// flush output buffers after printing
+			jobRemove(job);
+		}
+		job = next;
+	}
+}
+
+
+/* **********************************************************************************
+ ** Description: Finds the job named by an argument of a job control command - %n for
+		 job n, %% or %+ for the most recent job, or the pid of any of the
+		 job's processes. With no argument, the most recent job is used
+ ** Input(s): 	 The argument, or NULL
+ ** Output(s): 	 Displays an error message if there is no such job
+ ** Returns: 	 The job, or NULL if there is no such job
+ ** *******************************************************************************/
+struct job* findJob(const char* name, const char* spec)
+{
+	struct job* job;
+	struct job* last = NULL;
+
+	for (job = firstJob; job != NULL; job = job->next)
+	{
+		last = job;
+	}
+
+	if (spec == NULL || strcmp(spec, "%%") == 0 || strcmp(spec, "%+") == 0)
+	{
+		if (last == NULL)
+		{
+			fprintf(stderr, "%s: no current job\n", name);
+		}
+		return last;
+	}
+
+	if (spec[0] == '%')
+	{
+		int id = atoi(spec + 1);
+		for (job = firstJob; job != NULL && job->id != id; job = job->next);
+	}
+	else
+	{
+		pid_t pid = atoi(spec);
+		struct process* process = pidTable[pid % PID_BUCKETS];
+		while (process != NULL && process->pid != pid)
+		{
+			process = process->nextInBucket;
+		}
+		job = process != NULL ? process->job : NULL;
+	}
+
+	if (job == NULL)
+	{
+		fprintf(stderr, "%s: %s: no such job\n", name, spec);
+	}
+	return job;
+}
+
+
+// Returns the first job in the table, to walk the jobs in order of job ID
+struct job* jobsFirst()
+{
+	return firstJob;
+}
+
+
+// Returns the number of jobs in the table which have not finished
+static int countUnfinished()
+{
+	struct job* job;
+	int count = 0;
+	for (job = firstJob; job != NULL; job = job->next)
+	{
+		count += job->remaining > 0;
+	}
+	return count;
+}
+
+
+/* **********************************************************************************
+ ** Description: Ends every job in the table, for exit. Each job is sent SIGHUP and
+		 SIGTERM, and continued if it is stopped so that it can act on them.
+		 The jobs are given SHUTDOWN_GRACE seconds to finish, the shell
+		 sleeping until each SIGCHLD, and any still running are then killed
+		 with SIGKILL. Disowned jobs are not in the table, and are left alone.
+		 Last, the cgroups the shell made for its jobs are removed
+ ** Input(s): 	 No input
+ ** Output(s): 	 No output
+ ** Returns: 	 No return value
+ ** *******************************************************************************/
+void jobsShutdown()
+{
+	struct job* job;
+	for (job = firstJob; job != NULL; job = job->next)
+	{
+		if (job->remaining > 0)
+		{
+			kill(-job->pgid, SIGHUP);
+			kill(-job->pgid, SIGTERM);
+			continueJob(job);
+		}
+	}
+
+	struct timespec deadline;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += SHUTDOWN_GRACE;
+
+	// SIGCHLD is blocked, so it can be waited for directly
+	sigset_t childSignal;
+	sigemptyset(&childSignal);
+	sigaddset(&childSignal, SIGCHLD);
+	while (reapChildren() == 0 && countUnfinished() > 0)
+	{
+		struct timespec now, timeout;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		timeout.tv_sec = deadline.tv_sec - now.tv_sec;
+		timeout.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+		if (timeout.tv_nsec < 0)
+		{
+			timeout.tv_sec--;
+			timeout.tv_nsec += 1000000000;
+		}
+		if (timeout.tv_sec < 0)
+		{
+			break;
+		}
+		sigtimedwait(&childSignal, NULL, &timeout);
+	}
+
+	for (job = firstJob; job != NULL; job = job->next)
+	{
+		if (job->remaining > 0)
+		{
+			kill(-job->pgid, SIGKILL);
+		}
+	}
+	cgroupShutdown();
+}
+
+
+// Returns the state of a job for the jobs command
+static const char* jobState(struct job* job)
+{
+	if (job->remaining == 0) return "Done";
+	if (job->remaining == job->stopped) return "Stopped";
+	return "Running";
+}
+
+
+/* **********************************************************************************
+ ** Description: Waits for a job brought to the foreground (by fg or wait). If it
+		 finishes, it is removed from the table and its last command's exit
+		 method is kept for status. If it is stopped, it stays in the table as
+		 a background job
+ ** Input(s): 	 The job, pointer to the exit method of the last foreground process,
+		 and bool - whether to report a terminating signal
+ ** Output(s): 	 The terminating signal, or a message if the job stopped
+ ** Returns: 	 No return value
+ ** *******************************************************************************/
+static void finishJob(struct job* job, int* childExitMethod, int reportSignal)
+{
+	waitJob(job);
+
+	if (job->remaining > 0)
+	{
+		job->background = 1;
+		printf("\n[%d] Stopped	%s\n", job->id, job->text);
+		fflush(stdout);		// flush output buffers after printing
+		return;
+	}
+
+	*childExitMethod = job->exitMethod;
+	lastUsage = job->usage;
+	if (reportSignal == 1 && WIFSIGNALED(job->exitMethod) != 0)
+	{
+		printf("terminated by signal %d\n", WTERMSIG(job->exitMethod));
+		fflush(stdout);		// flush output buffers after printing
+	}
+	jobRemove(job);
+}
+
+
+/* **********************************************************************************
+ ** Description: Built-in commands for job control.
+		 jobs - lists each job with its ID, state, process group and command.
+		 fg [job] - continues a job in the foreground and waits for it.
+		 bg [job] - continues a stopped job in the background.
+		 wait [job] - waits for a job to finish, or for every running
+		 background job if none is given.
+		 disown [-a | job...] - removes jobs from the table (every job with
+		 -a), so they are not ended when the shell exits.
+ ** Input(s): 	 The command, and pointer to the exit method of the last foreground
+		 process (set by fg and wait)
+ ** Output(s): 	 Output of the command, or an error message
+ ** Returns: 	 The exit value of the command
+ ** *******************************************************************************/
+int jobsBuiltin(struct command* command, int* childExitMethod)
+{
+	struct job* job;
+
+	// reap first, so the states listed are up to date
+	notifyJobs();
+	for (job = firstJob; job != NULL; job = job->next)
+	{
+		printf("[%d] %-8s %d	%s\n", job->id, jobState(job), job->pgid, job->text);
+	}
+	fflush(stdout);		// flush output buffers after printing
+	return 0;
+}
+
+int fgBuiltin(struct command* command, int* childExitMethod)
+{
+	struct job* job = findJob("fg", command->argv[1]);
+	if (job == NULL)
+	{
+		*childExitMethod = EXIT_METHOD(1);
+		return 1;
+	}
+
+	printf("%s\n", job->text);
+	fflush(stdout);		// flush output buffers after printing
+
+	// the job is continued once it has the terminal (see waitJob)
+	job->background = 0;
+	finishJob(job, childExitMethod, 1);
+	return exitValue(*childExitMethod);
+}
+
+int bgBuiltin(struct command* command, int* childExitMethod)
+{
+	struct job* job = findJob("bg", command->argv[1]);
+	if (job == NULL)
+	{
+		*childExitMethod = EXIT_METHOD(1);
+		return 1;
+	}
+
+	printf("[%d] %s &\n", job->id, job->text);
+	fflush(stdout);		// flush output buffers after printing
+
+	job->background = 1;
+	lastBackgroundPid = job->pgid;
+	continueJob(job);
+	*childExitMethod = 0;
+	return 0;
+}
+
+int waitBuiltin(struct command* command, int* childExitMethod)
+{
+	struct job* job;
+
+	if (command->argc > 1)
+	{
+		job = findJob("wait", command->argv[1]);
+		if (job == NULL)
+		{
+			*childExitMethod = EXIT_METHOD(127);	// exit value 127, as in other shells
+			return 127;
+		}
+		finishJob(job, childExitMethod, 0);
+		return exitValue(*childExitMethod);
+	}
+
+	// wait for every background job that is running, taking them oldest first
+	*childExitMethod = 0;
+	job = firstJob;
+	while (job != NULL)
+	{
+		struct job* next = job->next;
+		if (job->background == 1 && job->remaining > job->stopped)
+		{
+			finishJob(job, childExitMethod, 0);
+		}
+		job = next;
+	}
+	return exitValue(*childExitMethod);
+}
+
+int disownBuiltin(struct command* command, int* childExitMethod)
+{
+	int i;
+
+	*childExitMethod = 0;
+	if (command->argc == 2 && strcmp(command->argv[1], "-a") == 0)
+	{
+		while (firstJob != NULL)
+		{
+			jobRemove(firstJob);
+		}
+		return 0;
+	}
+
+	// with no job given, the current job is disowned
+	for (i = 1; i == 1 || i < command->argc; i++)
+	{
+		struct job* job = findJob("disown", command->argv[i]);
+		if (job == NULL)
+		{
+			*childExitMethod = EXIT_METHOD(1);
+		}
+		else
+		{
+			jobRemove(job);
+		}
+	}
+	return exitValue(*childExitMethod);
+}
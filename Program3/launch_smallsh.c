@@ -0,0 +1,455 @@
+/* **********************************************************************************
+ ** Program Name:   Program 3 - smallsh (launch_smallsh.c)
+ ** Author:         Susan Hibbert
+ ** Date:           20th May 2020
+ ** Description:    Starts the processes for each command of a pipeline, and keeps the
+		    table of where each command's program was found in PATH. External
+		    commands are started with clone(CLONE_VM | CLONE_VFORK), so the
+		    child runs in the shell's memory until it calls execve and the
+		    shell's page tables are never copied, however large the shell
+		    grows. The shell is suspended until the child has called execve
+		    (or exited). Built-in commands in a pipeline need a copy of the
+		    shell to run in, so they are still started with fork()
+ ** *******************************************************************************/
+#include "smallsh.h"
+#include <sched.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#define CHILD_STACK_SIZE 65536	// stack used by a cloned child until it calls execve
+#define HASH_BUCKETS 64		// number of buckets in the command hash table
+#define DEFAULT_PATH "/bin:/usr/bin"	// searched when PATH is not set
+
+// a command name in the hash table, with the path it was found at
+struct hashEntry
+{
+	char* name;
+	char* path;
+	int hits;			// number of times the command was run using this entry
+	struct hashEntry* next;		// next entry in the same bucket
+};
+
+extern char** environ;
+
+// stack for cloned children. The shell is suspended while a cloned child uses it, so
+// one stack serves every child
+static char* childStack = NULL;
+
+// HASH TABLE
+// Command names are looked up in PATH once, and the path found is kept in the hash table
+// for the next time the command is run. An entry goes stale if its program is removed, so
+// a child whose execve fails with ENOENT searches PATH itself and tells the shell to drop
+// the entry
+static struct hashEntry* hashTable[HASH_BUCKETS];
+static char* hashedPath = NULL;		// value of PATH when the hash table was filled
+
+
+/* **********************************************************************************
+ ** Description: Searches the directories in PATH for a program, in the same way as
+		 execvp. Only uses the stack, so it is safe to call in a cloned child
+ ** Input(s): 	 The command name (without a '/'), and a string to hold the path
+		 (PATH_MAX chars)
+ ** Output(s): 	 No output
+ ** Returns: 	 The path of the program, or NULL if it was not found
+ ** *******************************************************************************/
+static char* searchPath(const char* name, char* path)
+{
+	const char* dirs = getenv("PATH");
+	if (dirs == NULL)
+	{
+		dirs = DEFAULT_PATH;
+	}
+
+	// try each directory in turn - an empty directory means the current one
+	int nameLength = strlen(name);
+	while (1)
+	{
+		const char* end = strchrnul(dirs, ':');
+		int dirLength = end - dirs;
+		struct stat fileInfo;
+
+		if (dirLength + nameLength + 2 <= PATH_MAX)
+		{
+			if (dirLength == 0)
+			{
+				memcpy(path, name, nameLength + 1);
+			}
+			else
+			{
+				memcpy(path, dirs, dirLength);
+				path[dirLength] = '/';
+				memcpy(path + dirLength + 1, name, nameLength + 1);
+			}
+			if (stat(path, &fileInfo) == 0 && S_ISREG(fileInfo.st_mode) && access(path, X_OK) == 0)
+			{
+				return path;
+			}
+		}
+
+		if (*end == '\0')
+		{
+			return NULL;
+		}
+		dirs = end + 1;
+	}
+}
+
+
+// Returns the bucket of the hash table for a command name (FNV-1a hash)
+static struct hashEntry** hashBucket(const char* name)
+{
+	unsigned int hash = 2166136261u;
+	const char* c;
+	for (c = name; *c != '\0'; c++)
+	{
+		hash = (hash ^ (unsigned char)*c) * 16777619u;
+	}
+	return &hashTable[hash % HASH_BUCKETS];
+}
+
+
+// Empties the hash table
+static void hashClear()
+{
+	int i;
+	for (i = 0; i < HASH_BUCKETS; i++)
+	{
+		while (hashTable[i] != NULL)
+		{
+			struct hashEntry* entry = hashTable[i];
+			hashTable[i] = entry->next;
+			free(entry->name);
+			free(entry->path);
+			free(entry);
+		}
+	}
+}
+
+
+// Removes a command from the hash table, if it is there
+static void hashForget(const char* name)
+{
+	struct hashEntry** link = hashBucket(name);
+	while (*link != NULL && strcmp((*link)->name, name) != 0)
+	{
+		link = &(*link)->next;
+	}
+	if (*link != NULL)
+	{
+		struct hashEntry* entry = *link;
+		*link = entry->next;
+		free(entry->name);
+		free(entry->path);
+		free(entry);
+	}
+}
+
+
+/* **********************************************************************************
+ ** Description: Finds the program to run for a command name. A name containing a
+		 '/' is used as it is. Other names are looked up in the hash table
+		 first, and PATH is only searched for names that are not there yet.
+		 The whole table is emptied if PATH has changed since it was filled
+ ** Input(s): 	 The command name, and a string to hold the path (PATH_MAX chars)
+ ** Output(s): 	 No output
+ ** Returns: 	 The path of the program, or NULL if it was not found
+ ** *******************************************************************************/
+char* findCommand(const char* name, char* path)
+{
+	if (strchr(name, '/') != NULL)
+	{
+		return strcpy(path, name);
+	}
+
+	const char* dirs = getenv("PATH");
+	if (dirs == NULL)
+	{
+		dirs = DEFAULT_PATH;
+	}
+	if (hashedPath == NULL || strcmp(hashedPath, dirs) != 0)
+	{
+		hashClear();
+		free(hashedPath);
+		hashedPath = strdup(dirs);
+	}
+
+	struct hashEntry** bucket = hashBucket(name);
+	struct hashEntry* entry;
+	for (entry = *bucket; entry != NULL; entry = entry->next)
+	{
+		if (strcmp(entry->name, name) == 0)
+		{
+			entry->hits++;
+			return strcpy(path, entry->path);
+		}
+	}
+
+	if (searchPath(name, path) == NULL)
+	{
+		return NULL;
+	}
+	entry = malloc(sizeof(struct hashEntry));
+	entry->name = strdup(name);
+	entry->path = strdup(path);
+	entry->hits = 1;
+	entry->next = *bucket;
+	*bucket = entry;
+	return path;
+}
+
+
+/* **********************************************************************************
+ ** Description: Built-in command hash. With no arguments it lists the hash table
+		 (how many times each command has been run from it, and its path).
+		 hash -r empties the table, and hash name... looks up each name and
+		 adds it to the table
+ ** Input(s): 	 The command, and pointer to the exit method of the last foreground
+		 process (set to exit value 1 if a name is not found)
+ ** Output(s): 	 The hash table, or an error message for a name that is not found
+ ** Returns: 	 The exit value of the command
+ ** *******************************************************************************/
+int hashBuiltin(struct command* command, int* childExitMethod)
+{
+	char path[PATH_MAX];
+	int i;
+
+	*childExitMethod = 0;
+	if (command->argc == 1)
+	{
+		int empty = 1;
+		for (i = 0; i < HASH_BUCKETS; i++)
+		{
+			struct hashEntry* entry;
+			for (entry = hashTable[i]; entry != NULL; entry = entry->next)
+			{
+				if (empty == 1)
+				{
+					printf("hits	command\n");
+					empty = 0;
+				}
+				printf("%4d	%s\n", entry->hits, entry->path);
+			}
+		}
+		if (empty == 1)
+		{
+			printf("hash: hash table empty\n");
+		}
+		fflush(stdout);		// flush output buffers after printing
+		return 0;
+	}
+
+	for (i = 1; i < command->argc; i++)
+	{
+		if (strcmp(command->argv[i], "-r") == 0)
+		{
+			hashClear();
+		}
+		else if (strchr(command->argv[i], '/') == NULL)
+		{
+			// a name looked up by hash has not been run yet
+			hashForget(command->argv[i]);
+			if (findCommand(command->argv[i], path) == NULL)
+			{
+				fprintf(stderr, "hash: %s: not found\n", command->argv[i]);
+				*childExitMethod = EXIT_METHOD(1);
+			}
+			else
+			{
+				(*hashBucket(command->argv[i]))->hits = 0;
+			}
+		}
+	}
+	return exitValue(*childExitMethod);
+}
+
+
+/* **********************************************************************************
+ ** Description: Prepares a newly started child for its command. The child joins the
+		 pipeline's process group (taking the terminal, for a foreground job),
+		 puts its signal handlers back to their defaults (background commands
+		 ignore SIGINT), unblocks the signals the shell reads from its
+		 signalfd by restoring the signal mask it started with, connects to
+		 the pipes on either side of it and applies the command's
+		 redirections.
+		 A cloned child shares the shell's memory, so errors are written with
+		 dprintf rather than through the shell's stdio buffers
+ ** Input(s): 	 Details of the command to start
+ ** Output(s): 	 Error messages are displayed if a redirection fails
+ ** Returns: 	 Returns 0, or -1 if the command cannot be run
+ ** *******************************************************************************/
+static int setupChild(struct launch* launch)
+{
+	// a profiled command's counters are sent first, as the shell waits for them, and
+	// before ulimit can limit its open files. A built-in command never executes, so its
+	// counters count from now on
+	if (launch->profileFD != -1)
+	{
+		profileChild(launch->profileFD, launch->builtin == 1 ? 0 : 1);
+	}
+
+	// join the pipeline's process group (the first child starts it). The parent does the
+	// same, so the group exists whichever of them runs first. A foreground job takes the
+	// terminal before its command runs, so the command cannot be stopped for reading it
+	setpgid(0, launch->pgid);
+	if (launch->terminalFD != -1)
+	{
+		tcsetpgrp(launch->terminalFD, getpgrp());
+	}
+
+	// SET UP SIGNAL HANDLERS FOR CHILD PROCESS
+	// the shell's handlers must not run in the child, so every caught signal goes back to
+	// its default behaviour before signals are unblocked
+	struct sigaction action = {0};
+	struct sigaction old;
+	int sig;
+
+	sigemptyset(&action.sa_mask);
+	action.sa_handler = SIG_DFL;
+	for (sig = 1; sig < NSIG; sig++)
+	{
+		if (sigaction(sig, NULL, &old) == 0 && old.sa_handler != SIG_DFL && old.sa_handler != SIG_IGN)
+		{
+			sigaction(sig, &action, NULL);
+		}
+	}
+
+	// foreground commands are terminated by SIGINT, background commands ignore it
+	action.sa_handler = launch->runBackground == 1 ? SIG_IGN : SIG_DFL;
+	sigaction(SIGINT, &action, NULL);
+
+	sigprocmask(SIG_SETMASK, launch->mask, NULL);
+
+	// connect to the pipes on either side. If no input is given for the start of a background
+	// pipeline, or no output for its end, they are redirected to /dev/null. The pipe ends are
+	// close-on-exec, so only the copies on stdin and stdout are passed on
+	int inFD = launch->inFD;
+	int outFD = launch->outFD;
+	if (launch->runBackground == 1 && (inFD == -1 || outFD == -1))
+	{
+		int target = open("/dev/null", O_RDWR | O_CLOEXEC);
+		if (inFD == -1) inFD = target;
+		if (outFD == -1) outFD = target;
+	}
+	if ((inFD != -1 && dup2(inFD, 0) == -1) || (outFD != -1 && dup2(outFD, 1) == -1))
+	{
+		dprintf(2, "Error with pipe redirection: %s\n", strerror(errno));
+		return -1;
+	}
+
+	// the pipes of the command's process substitutions are passed on, to be opened by name
+	struct substitution* substitution;
+	for (substitution = launch->command->substitutions; substitution != NULL; substitution = substitution->next)
+	{
+		fcntl(substitution->fd, F_SETFD, 0);
+	}
+
+	// the command's own redirections follow, in the order they were entered
+	if (applyRedirects(launch->command->redirects, NULL) == -1)
+	{
+		return -1;
+	}
+
+	// last, the limits set by ulimit and the job's cgroup, which the shell is not bound by
+	return applyLimits(launch->cgroupFD);
+}
+
+
+// Entry point of a cloned child - sets up the child and executes the command, setting the
+// exit status to 1 if it cannot be run
+static int launchChild(void* arg)
+{
+	struct launch* launch = arg;
+
+	if (setupChild(launch) == 0)
+	{
+		if (launch->path != NULL)
+		{
+			execve(launch->path, launch->command->argv, environ);
+
+			// the program found earlier has gone - search PATH again. The child shares
+			// the shell's memory, so the flag is seen by the shell once the child has
+			// called execve or exited
+			char path[PATH_MAX];
+			if (errno == ENOENT && strchr(launch->command->argv[0], '/') == NULL)
+			{
+				launch->staleHash = 1;
+				if (searchPath(launch->command->argv[0], path) != NULL)
+				{
+					execve(path, launch->command->argv, environ);
+				}
+			}
+		}
+
+		// if non-built in command does not exist, display error message
+		dprintf(1, "%s: no such file or directory\n", launch->command->argv[0]);
+	}
+	_exit(1);
+}
+
+
+/* **********************************************************************************
+ ** Description: Starts the process for one command of a pipeline. All signals are
+		 blocked while the child is started, so none of the shell's handlers
+		 can run in the child before it has reset them
+ ** Input(s): 	 Details of the command to start (see smallsh.h)
+ ** Output(s): 	 Displays an error message if the process cannot be started
+ ** Returns: 	 The pid of the child, or -1 if it could not be started
+ ** *******************************************************************************/
+pid_t spawnStage(struct launch* launch)
+{
+	sigset_t blockAll, saved;
+	char path[PATH_MAX];
+	pid_t spawnPid;
+
+	if (childStack == NULL)
+	{
+		childStack = mmap(NULL, CHILD_STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+		if (childStack == MAP_FAILED)
+		{
+			childStack = NULL;
+			perror("Unable to allocate child stack\n");
+			return -1;
+		}
+	}
+
+	sigfillset(&blockAll);
+	sigprocmask(SIG_SETMASK, &blockAll, &saved);
+	launch->mask = &childMask;
+
+	if (findBuiltin(launch->command->argv[0]) != NULL)
+	{
+		// a built-in command runs in a copy of the shell
+		launch->builtin = 1;
+		spawnPid = fork();
+		if (spawnPid == 0)
+		{
+			if (setupChild(launch) == -1)
+			{
+				_exit(1);
+			}
+			execBuiltin(launch->command, launch->childExitMethod);
+		}
+	}
+	else
+	{
+		// the program is looked up before the clone, so the child only has to call execve.
+		// The stack grows down from the end of childStack
+		launch->path = findCommand(launch->command->argv[0], path);
+		spawnPid = clone(launchChild, childStack + CHILD_STACK_SIZE, CLONE_VM | CLONE_VFORK | SIGCHLD, launch);
+		if (launch->staleHash == 1)
+		{
+			hashForget(launch->command->argv[0]);
+		}
+	}
+
+	sigprocmask(SIG_SETMASK, &saved, NULL);
+
+	// if an error occured in starting the process
+	if (spawnPid == -1)
+	{
+		perror("Unable to spawn child process\n");
+		fflush(stderr);		// flush output buffers after printing
+	}
+	return spawnPid;
+}
@@ -0,0 +1,614 @@
+/* **********************************************************************************
+ ** Program Name:   Program 3 - smallsh (limits_smallsh.c)
+ ** Author:         Susan Hibbert
+ ** Date:           20th May 2020
+ ** Description:    Resource limits for the commands smallsh runs, so that a runaway
+		    job cannot starve the shell. The shell's own limits are left
+		    alone: the limits are applied by each child just before it
+		    executes its command.
+
+		    USAGE: ulimit [-a]
+			   ulimit [-S | -H] -t|-v|-n|-u [limit | unlimited]
+
+		    -t is CPU time in seconds, -v virtual memory in kbytes, -n open
+		    files and -u processes. -S sets only the soft limit and -H only
+		    the hard limit (by default both are set).
+
+		    USAGE: cgroup [-c percent | max] [-m bytes[K|M|G] | max]
+			   cgroup off
+			   cgroup
+
+		    With cgroup v2 mounted and the shell's cgroup delegated to the
+		    user (for example with systemd-run --user --scope -p
+		    Delegate=yes), cgroup -c or -m puts each new job in a cgroup of
+		    its own, with cpu.max (percent of one CPU) and memory.max set.
+		    A controller is only enabled once a limit other than max is set.
+		    The shell moves itself into a leaf of its own first, as only a
+		    cgroup without processes can share out its controllers. cgroup
+		    alone lists the CPU time, memory and memory pressure of each job,
+		    and cgroup off stops placing new jobs
+ ** *******************************************************************************/
+#include "smallsh.h"
+#include <errno.h>
+#include <sys/stat.h>
+
+#define NUM_LIMITS 4		// number of limits ulimit can set
+
+// a limit ulimit can set, and the option that names it
+struct limitInfo
+{
+	char option;
+	int resource;
+	rlim_t unit;			// bytes in one unit of the value given to ulimit
+	const char* name;
+};
+
+static const struct limitInfo limits[NUM_LIMITS] = {
+	{ 't', RLIMIT_CPU, 1, "cpu time (seconds)" },
+	{ 'v', RLIMIT_AS, 1024, "virtual memory (kbytes)" },
+	{ 'n', RLIMIT_NOFILE, 1, "open files" },
+	{ 'u', RLIMIT_NPROC, 1, "max user processes" },
+};
+
+// the limits given to each command, and whether ulimit has set them
+static struct rlimit childLimits[NUM_LIMITS];
+static int limitSet[NUM_LIMITS];
+
+// CGROUPS
+// Once placement is on, the shell's cgroup holds a cgroup for this shell, with the shell
+// itself in a leaf named shell and each job in a leaf named after its sequence number
+static char* shellCgroup = NULL;	// the shell's cgroup directory, NULL until set up
+static char* startCgroup = NULL;	// the cgroup the shell started in
+static int placeJobs = 0;		// bool - new jobs are put in cgroups of their own
+static char cpuMax[32] = "max";		// cpu.max of each job's cgroup
+static char memoryMax[32] = "max";	// memory.max of each job's cgroup
+static int cpuEnabled = 0;		// bool - the cpu controller is enabled for the jobs
+static int memoryEnabled = 0;		// bool - the memory controller is enabled for the jobs
+static unsigned int nextCgroup = 1;	// number of the next job's cgroup
+
+
+/* **********************************************************************************
+ ** Description: Applies the limits set by ulimit and places the process in its
+		 job's cgroup. Called in a newly started child, just before it
+		 executes its command, so only system calls are used
+ ** Input(s): 	 cgroup.procs of the job's cgroup, or -1
+ ** Output(s): 	 Displays an error message if a limit cannot be applied
+ ** Returns: 	 Returns 0, or -1 if the command cannot be run
+ ** *******************************************************************************/
+int applyLimits(int cgroupFD)
+{
+	int i;
+
+	// writing 0 moves the process that writes it
+	if (cgroupFD != -1 && write(cgroupFD, "0", 1) != 1)
+	{
+		dprintf(2, "smallsh: cgroup: %s\n", strerror(errno));
+		return -1;
+	}
+	for (i = 0; i < NUM_LIMITS; i++)
+	{
+		if (limitSet[i] == 1 && setrlimit(limits[i].resource, &childLimits[i]) == -1)
+		{
+			dprintf(2, "smallsh: ulimit: %s: %s\n", limits[i].name, strerror(errno));
+			return -1;
+		}
+	}
+	return 0;
+}
+
+
+// Prints a limit, in the units ulimit uses
+static void printLimit(rlim_t value, rlim_t unit)
+{
+	if (value == RLIM_INFINITY)
+	{
+		printf("unlimited\n");
+	}
+	else
+	{
+		printf("%llu\n", (unsigned long long)(value / unit));
+	}
+}
+
+
+/* **********************************************************************************
+ ** Description: Built-in command ulimit (see the top of this file). Prints or sets
+		 the limits given to the commands the shell starts. A limit that has
+		 not been set is the shell's own
+ ** Input(s): 	 The command, and pointer to the exit method of the last foreground
+		 process
+ ** Output(s): 	 The limits, or an error message
+ ** Returns: 	 Returns 0, 1 if a limit cannot be set, or 2 if the command is not
+		 used properly
+ ** *******************************************************************************/
+int ulimitBuiltin(struct command* command, int* childExitMethod)
+{
+	int soft = 1;
+	int hard = 1;
+	int which = -1;
+	int all = command->argc == 1;
+	const char* value = NULL;
+	int i, j;
+
+	for (i = 1; i < command->argc; i++)
+	{
+		const char* arg = command->argv[i];
+		if (strcmp(arg, "-a") == 0) all = 1;
+		else if (strcmp(arg, "-S") == 0) hard = 0;
+		else if (strcmp(arg, "-H") == 0) soft = 0;
+		else if (arg[0] == '-' && arg[1] != '\0' && arg[2] == '\0')
+		{
+			for (j = 0; j < NUM_LIMITS && limits[j].option != arg[1]; j++);
+			if (j == NUM_LIMITS) break;
+			which = j;
+		}
+		else if (value == NULL && which != -1) value = arg;
+		else break;
+	}
+	if (i < command->argc || (all == 0 && which == -1) || soft + hard == 0)
+	{
+		fprintf(stderr, "USAGE: ulimit [-a]\n       ulimit [-S | -H] -t|-v|-n|-u [limit | unlimited]\n");
+		*childExitMethod = EXIT_METHOD(2);
+		return 2;
+	}
+
+	// the limits a command would be given now
+	struct rlimit current[NUM_LIMITS];
+	for (j = 0; j < NUM_LIMITS; j++)
+	{
+		if (limitSet[j] == 1) current[j] = childLimits[j];
+		else getrlimit(limits[j].resource, &current[j]);
+	}
+
+	*childExitMethod = 0;
+	if (value == NULL)
+	{
+		for (j = all == 1 ? 0 : which; j < (all == 1 ? NUM_LIMITS : which + 1); j++)
+		{
+			if (all == 1) printf("%-26s (-%c) ", limits[j].name, limits[j].option);
+			printLimit(hard == 1 && soft == 0 ? current[j].rlim_max : current[j].rlim_cur, limits[j].unit);
+		}
+		fflush(stdout);		// flush output buffers after printing
+		return 0;
+	}
+
+	rlim_t newLimit = RLIM_INFINITY;
+	if (strcmp(value, "unlimited") != 0)
+	{
+		char* end;
+		errno = 0;
+		unsigned long long number = strtoull(value, &end, 10);
+		if (*end != '\0' || end == value || errno != 0 || value[0] == '-')
+		{
+			fprintf(stderr, "ulimit: %s: invalid number\n", value);
+			*childExitMethod = EXIT_METHOD(1);
+			return 1;
+		}
+		if (number > RLIM_INFINITY / limits[which].unit)
+		{
+			fprintf(stderr, "ulimit: %s: value too large\n", value);
+			*childExitMethod = EXIT_METHOD(1);
+			return 1;
+		}
+		newLimit = number * limits[which].unit;
+	}
+
+	// the shell's own hard limit cannot be raised for its children without privilege
+	struct rlimit proposed = current[which];
+	struct rlimit shellLimit;
+	getrlimit(limits[which].resource, &shellLimit);
+	if (soft == 1) proposed.rlim_cur = newLimit;
+	if (hard == 1) proposed.rlim_max = newLimit;
+	if (proposed.rlim_cur > proposed.rlim_max ||
+	    (proposed.rlim_max > shellLimit.rlim_max && geteuid() != 0))
+	{
+		fprintf(stderr, "ulimit: %s: cannot be more than the hard limit\n", limits[which].name);
+		*childExitMethod = EXIT_METHOD(1);
+		return 1;
+	}
+	childLimits[which] = proposed;
+	limitSet[which] = 1;
+	return 0;
+}
+
+
+// Writes a string to a file. Returns 0, or -1 if it cannot be written
+static int writeFile(const char* path, const char* text)
+{
+	int fd = open(path, O_WRONLY | O_CLOEXEC);
+	if (fd == -1)
+	{
+		return -1;
+	}
+	ssize_t length = strlen(text);
+	int result = write(fd, text, length) == length ? 0 : -1;
+	close(fd);
+	return result;
+}
+
+
+// Reads the start of a file into a string, without its trailing newline. Returns 0, or -1
+// if it cannot be read
+static int readFile(const char* path, char* buffer, size_t size)
+{
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+	{
+		return -1;
+	}
+	ssize_t length = read(fd, buffer, size - 1);
+	close(fd);
+	if (length < 0)
+	{
+		return -1;
+	}
+	while (length > 0 && buffer[length - 1] == '\n')
+	{
+		length--;
+	}
+	buffer[length] = '\0';
+	return 0;
+}
+
+
+/* **********************************************************************************
+ ** Description: Finds the shell's cgroup - the cgroup v2 mount (from mountinfo) and
+		 the shell's path in it (from /proc/self/cgroup) - and moves the shell
+		 into a leaf of a cgroup of its own, so that the controllers can be
+		 enabled for the jobs
+ ** Input(s): 	 No input
+ ** Output(s): 	 Displays an error message if cgroup v2 is not mounted or the shell's
+		 cgroup is not delegated
+ ** Returns: 	 Returns 0, or -1 if jobs cannot be put in cgroups
+ ** *******************************************************************************/
+static int cgroupInit()
+{
+	char mount[PATH_MAX] = "";
+	char relative[PATH_MAX] = "";
+	char* line = NULL;
+	size_t lineSize = 0;
+
+	if (shellCgroup != NULL)
+	{
+		return 0;
+	}
+
+	// mountinfo lines hold the mount point fifth, and the file system type after " - "
+	FILE* file = fopen("/proc/self/mountinfo", "r");
+	while (file != NULL && mount[0] == '\0' && getline(&line, &lineSize, file) != -1)
+	{
+		char point[PATH_MAX];
+		char* type = strstr(line, " - ");
+		if (type != NULL && strncmp(type, " - cgroup2 ", 11) == 0 &&
+		    sscanf(line, "%*s %*s %*s %*s %4095s", point) == 1)
+		{
+			strcpy(mount, point);
+		}
+	}
+	if (file != NULL) fclose(file);
+
+	// the shell's cgroup v2 path is on the line for hierarchy 0
+	file = fopen("/proc/self/cgroup", "r");
+	while (file != NULL && relative[0] == '\0' && getline(&line, &lineSize, file) != -1)
+	{
+		if (strncmp(line, "0::", 3) == 0)
+		{
+			line[strcspn(line, "\n")] = '\0';
+			snprintf(relative, sizeof(relative), "%s", strcmp(line + 3, "/") == 0 ? "" : line + 3);
+			strcat(relative, "/");
+		}
+	}
+	if (file != NULL) fclose(file);
+	free(line);
+
+	if (mount[0] == '\0' || relative[0] == '\0')
+	{
+		fprintf(stderr, "cgroup: cgroup v2 is not mounted\n");
+		return -1;
+	}
+
+	char path[PATH_MAX];
+	char pid[24];
+	char* start = malloc(PATH_MAX);
+	char* own = malloc(PATH_MAX);
+	sprintf(pid, "%ld", (long)getpid());
+	if (snprintf(start, PATH_MAX, "%s%s", mount, relative) >= PATH_MAX ||
+	    snprintf(own, PATH_MAX, "%ssmallsh-%s", start, pid) >= PATH_MAX ||
+	    snprintf(path, sizeof(path), "%s/shell", own) >= (int)sizeof(path))
+	{
+		fprintf(stderr, "cgroup: %s%s: path too long\n", mount, relative);
+		free(start);
+		free(own);
+		return -1;
+	}
+
+	// the shell is moved into its leaf, as its cgroup cannot have both processes and
+	// controllers enabled for its children
+	char procs[PATH_MAX + 16];
+	snprintf(procs, sizeof(procs), "%s/cgroup.procs", path);
+	if ((mkdir(own, 0755) == -1 && errno != EEXIST) || (mkdir(path, 0755) == -1 && errno != EEXIST) ||
+	    writeFile(procs, pid) == -1)
+	{
+		fprintf(stderr, "cgroup: %s%s is not delegated: %s\n", mount, relative, strerror(errno));
+		rmdir(path);
+		rmdir(own);
+		free(start);
+		free(own);
+		return -1;
+	}
+	startCgroup = start;
+	shellCgroup = own;
+	return 0;
+}
+
+
+// Moves the shell back to the cgroup it started in and removes the cgroups it made, when
+// the shell exits. The cgroups of jobs which are still running are left behind
+void cgroupShutdown()
+{
+	char path[PATH_MAX + 16];
+	char pid[24];
+
+	if (shellCgroup == NULL)
+	{
+		return;
+	}
+	for (struct job* job = jobsFirst(); job != NULL; job = job->next)
+	{
+		if (job->cgroup != NULL) rmdir(job->cgroup);
+	}
+	sprintf(pid, "%ld", (long)getpid());
+	snprintf(path, sizeof(path), "%scgroup.procs", startCgroup);
+	writeFile(path, pid);
+	snprintf(path, sizeof(path), "%s/shell", shellCgroup);
+	rmdir(path);
+	rmdir(shellCgroup);
+}
+
+
+// Enables a controller (cpu or memory) for the jobs' cgroups - in the cgroup the shell
+// started in, and in the shell's own. Returns 0, or -1 if it is not available
+static int enableController(const char* name)
+{
+	char path[PATH_MAX];
+	char change[16];
+
+	snprintf(change, sizeof(change), "+%s", name);
+	snprintf(path, sizeof(path), "%s/../cgroup.subtree_control", shellCgroup);
+	writeFile(path, change);
+	snprintf(path, sizeof(path), "%s/cgroup.subtree_control", shellCgroup);
+	if (writeFile(path, change) == -1)
+	{
+		fprintf(stderr, "cgroup: the %s controller is not available: %s\n", name, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+
+/* **********************************************************************************
+ ** Description: Gives a new job a cgroup of its own, with the cpu.max and memory.max
+		 set by the cgroup command, if jobs are being placed in cgroups
+ ** Input(s): 	 The job
+ ** Output(s): 	 Displays an error message if the cgroup cannot be made
+ ** Returns: 	 cgroup.procs of the job's cgroup, for each of its processes to join
+		 (see applyLimits), or -1 if the job has no cgroup
+ ** *******************************************************************************/
+int cgroupCreateJob(struct job* job)
+{
+	char path[PATH_MAX];
+
+	if (placeJobs == 0)
+	{
+		return -1;
+	}
+	job->cgroup = malloc(PATH_MAX);
+	snprintf(job->cgroup, PATH_MAX, "%s/job%u", shellCgroup, nextCgroup++);
+	if (mkdir(job->cgroup, 0755) == -1)
+	{
+		fprintf(stderr, "cgroup: %s: %s\n", job->cgroup, strerror(errno));
+		free(job->cgroup);
+		job->cgroup = NULL;
+		return -1;
+	}
+
+	snprintf(path, sizeof(path), "%s/cpu.max", job->cgroup);
+	if (cpuEnabled == 1 && writeFile(path, cpuMax) == -1)
+	{
+		fprintf(stderr, "cgroup: %s: %s\n", path, strerror(errno));
+	}
+	snprintf(path, sizeof(path), "%s/memory.max", job->cgroup);
+	if (memoryEnabled == 1 && writeFile(path, memoryMax) == -1)
+	{
+		fprintf(stderr, "cgroup: %s: %s\n", path, strerror(errno));
+	}
+	snprintf(path, sizeof(path), "%s/cgroup.procs", job->cgroup);
+	return open(path, O_WRONLY | O_CLOEXEC);
+}
+
+
+// Removes a job's cgroup, once the job has finished. A cgroup which still has processes
+// (a disowned job) cannot be removed, and is left behind
+void cgroupRemoveJob(struct job* job)
+{
+	if (job->cgroup != NULL)
+	{
+		rmdir(job->cgroup);
+		free(job->cgroup);
+		job->cgroup = NULL;
+	}
+}
+
+
+// Prints the CPU time, memory and memory pressure of a job's cgroup, for the cgroup command
+static void printCgroup(struct job* job)
+{
+	char path[PATH_MAX];
+	char text[512];
+	long long usec = 0;
+	long long memory = -1;
+
+	snprintf(path, sizeof(path), "%s/cpu.stat", job->cgroup);
+	if (readFile(path, text, sizeof(text)) == 0)
+	{
+		sscanf(text, "usage_usec %lld", &usec);
+	}
+	snprintf(path, sizeof(path), "%s/memory.current", job->cgroup);
+	if (readFile(path, text, sizeof(text)) == 0)
+	{
+		memory = atoll(text) / 1024;
+	}
+	printf("[%d] %s: cpu %.3fs", job->id, job->text, usec / 1e6);
+	if (memory >= 0)
+	{
+		printf(", memory %lld KB", memory);
+	}
+
+	// the first line of memory.pressure is the share of time some task waited for memory
+	snprintf(path, sizeof(path), "%s/memory.pressure", job->cgroup);
+	if (readFile(path, text, sizeof(text)) == 0)
+	{
+		text[strcspn(text, "\n")] = '\0';
+		printf(", memory pressure %s", text);
+	}
+	printf("\n");
+}
+
+
+// Turns a size given to cgroup -m (bytes, or with a K, M or G suffix) into the text for
+// memory.max. Returns 0, or -1 if it is not a size
+static int parseSize(const char* value, char* text, size_t size)
+{
+	char* end;
+	if (strcmp(value, "max") == 0)
+	{
+		snprintf(text, size, "max");
+		return 0;
+	}
+	int shift = 0;
+	errno = 0;
+	unsigned long long bytes = strtoull(value, &end, 10);
+	if (end == value || value[0] == '-' || errno != 0)
+	{
+		return -1;
+	}
+	switch (*end)
+	{
+		case 'G': case 'g': shift += 10;
+			/* fallthrough */
+		case 'M': case 'm': shift += 10;
+			/* fallthrough */
+		case 'K': case 'k': shift += 10; end++;
+	}
+	if (*end != '\0' || bytes > ULLONG_MAX >> shift)
+	{
+		return -1;
+	}
+	bytes <<= shift;
+	snprintf(text, size, "%llu", bytes);
+	return 0;
+}
+
+
+/* **********************************************************************************
+ ** Description: Built-in command cgroup (see the top of this file). Sets the limits
+		 of the cgroups new jobs are put in, turns placement off, or lists
+		 the jobs' cgroups
+ ** Input(s): 	 The command, and pointer to the exit method of the last foreground
+		 process
+ ** Output(s): 	 The jobs' cgroups, or an error message
+ ** Returns: 	 Returns 0, 1 if cgroups cannot be used, or 2 if the command is not
+		 used properly
+ ** *******************************************************************************/
+int cgroupBuiltin(struct command* command, int* childExitMethod)
+{
+	const char* cpu = NULL;
+	const char* memory = NULL;
+	char text[32];
+	int i;
+
+	*childExitMethod = 0;
+	if (command->argc == 2 && strcmp(command->argv[1], "off") == 0)
+	{
+		placeJobs = 0;
+		return 0;
+	}
+	if (command->argc == 1)
+	{
+		if (placeJobs == 0)
+		{
+			printf("cgroup: jobs are not placed in cgroups\n");
+		}
+		else
+		{
+			printf("cgroup: jobs placed in %s, cpu.max %s, memory.max %s\n", shellCgroup, cpuMax, memoryMax);
+		}
+		for (struct job* job = jobsFirst(); job != NULL; job = job->next)
+		{
+			if (job->cgroup != NULL)
+			{
+				printCgroup(job);
+			}
+		}
+		fflush(stdout);		// flush output buffers after printing
+		return 0;
+	}
+
+	for (i = 1; i + 1 < command->argc; i += 2)
+	{
+		if (strcmp(command->argv[i], "-c") == 0) cpu = command->argv[i + 1];
+		else if (strcmp(command->argv[i], "-m") == 0) memory = command->argv[i + 1];
+		else break;
+	}
+	if (i != command->argc)
+	{
+		fprintf(stderr, "USAGE: cgroup [-c percent | max] [-m bytes[K|M|G] | max]\n       cgroup off\n       cgroup\n");
+		*childExitMethod = EXIT_METHOD(2);
+		return 2;
+	}
+
+	if (cgroupInit() == -1)
+	{
+		*childExitMethod = EXIT_METHOD(1);
+		return 1;
+	}
+	if (cpu != NULL)
+	{
+		// a percentage of one CPU, as a quota per 100ms period
+		char* end;
+		long percent = strtol(cpu, &end, 10);
+		if (strcmp(cpu, "max") == 0) snprintf(text, sizeof(text), "max 100000");
+		else if (*end == '\0' && end != cpu && percent > 0) snprintf(text, sizeof(text), "%ld 100000", percent * 1000);
+		else
+		{
+			fprintf(stderr, "cgroup: %s: invalid percentage\n", cpu);
+			*childExitMethod = EXIT_METHOD(1);
+			return 1;
+		}
+		if (cpuEnabled == 0 && strcmp(cpu, "max") != 0 && enableController("cpu") == -1)
+		{
+			*childExitMethod = EXIT_METHOD(1);
+			return 1;
+		}
+		cpuEnabled = cpuEnabled == 1 || strcmp(cpu, "max") != 0;
+		strcpy(cpuMax, text);
+	}
+	if (memory != NULL)
+	{
+		if (parseSize(memory, text, sizeof(text)) == -1)
+		{
+			fprintf(stderr, "cgroup: %s: invalid size\n", memory);
+			*childExitMethod = EXIT_METHOD(1);
+			return 1;
+		}
+		if (memoryEnabled == 0 && strcmp(memory, "max") != 0 && enableController("memory") == -1)
+		{
+			*childExitMethod = EXIT_METHOD(1);
+			return 1;
+		}
+		memoryEnabled = memoryEnabled == 1 || strcmp(memory, "max") != 0;
+		strcpy(memoryMax, text);
+	}
+	placeJobs = 1;
+	return 0;
+}
@@ -0,0 +1,354 @@
+/* **********************************************************************************
+ ** Program Name:   Program 3 - smallsh (parallel_smallsh.c)
+ ** Author:         Susan Hibbert
+ ** Date:           20th May 2020
+ ** Description:    The parallel built-in command for the smallsh program. It runs a
+		    command once for each line of its input, keeping up to N of them
+		    running at a time.
+
+		    USAGE: parallel [-j N] [-k] [-a file] command [args...]
+
+		    Each line replaces {} in the arguments, or is added as the last
+		    argument if there is no {}. -j sets how many commands run at once
+		    (default: the number of CPUs), -k writes each command's output in
+		    the order of the input lines, and -a reads the lines from a file
+		    rather than stdin.
+
+		    parallel runs as a job, in a copy of the shell, so CTRL-C, & and
+		    the job control commands work on it like any other pipeline. The
+		    commands it starts join its process group, are started by
+		    spawnStage and are kept in the copy's job table. The copy sleeps in
+		    waitpid until a command finishes, then starts the next one
+ ** *******************************************************************************/
+#include "smallsh.h"
+#include <errno.h>
+#include <sys/mman.h>
+
+#define MAX_PARALLEL 1024	// most commands parallel will run at once
+
+// a command started by parallel
+struct task
+{
+	struct job* job;		// the command's job, NULL if the slot is free
+	int line;			// number of the input line it was started for
+	int outFD;			// memory file holding its output (-k only), otherwise -1
+	char** argv;			// its arguments
+	int finished;			// bool - it has finished, but its output is still held
+};
+
+
+// Frees a task's arguments and marks its slot as free
+static void freeTask(struct task* task)
+{
+	int i;
+	for (i = 0; task->argv[i] != NULL; i++)
+	{
+		free(task->argv[i]);
+	}
+	free(task->argv);
+	if (task->outFD != -1)
+	{
+		close(task->outFD);
+	}
+	task->job = NULL;
+	task->finished = 0;
+}
+
+
+/* **********************************************************************************
+ ** Description: Builds the arguments of a command for one input line - the template
+		 with every {} replaced by the line, or with the line added at the end
+		 if the template has no {}
+ ** Input(s): 	 The template's arguments (terminated by NULL), and the input line
+ ** Output(s): 	 No output
+ ** Returns: 	 The arguments, terminated by NULL, each malloc'd
+ ** *******************************************************************************/
+static char** buildArgs(char** template, const char* line)
+{
+	int count;
+	int replaced = 0;
+	int i;
+
+	for (count = 0; template[count] != NULL; count++);
+	char** argv = malloc((count + 2) * sizeof(char*));
+	size_t lineLength = strlen(line);
+
+	for (i = 0; i < count; i++)
+	{
+		// size the argument for every {} it holds, then copy it in
+		const char* src = template[i];
+		const char* mark;
+		int marks = 0;
+		for (mark = strstr(src, "{}"); mark != NULL; mark = strstr(mark + 2, "{}"))
+		{
+			marks++;
+		}
+		char* dest = malloc(strlen(src) + marks * lineLength + 1);
+		argv[i] = dest;
+		while ((mark = strstr(src, "{}")) != NULL)
+		{
+			memcpy(dest, src, mark - src);
+			dest += mark - src;
+			memcpy(dest, line, lineLength);
+			dest += lineLength;
+			src = mark + 2;
+		}
+		strcpy(dest, src);
+		replaced += marks;
+	}
+
+	if (replaced == 0)
+	{
+		argv[count++] = strdup(line);
+	}
+	argv[count] = NULL;
+	return argv;
+}
+
+
+/* **********************************************************************************
+ ** Description: Starts the command for one input line, as a job of its own in the
+		 group of the parallel command. Its stdin is /dev/null, so it cannot
+		 take parallel's input lines, and with -k its output goes to a memory
+		 file until it can be written in order
+ ** Input(s): 	 The slot to start it in, the template's arguments, the input line,
+		 its line number, bool - keep the output in order, and /dev/null
+ ** Output(s): 	 Displays an error message if the command cannot be started
+ ** Returns: 	 Returns 0, or -1 if the command could not be started (the task is
+		 then left finished, with no output)
+ ** *******************************************************************************/
+static int startTask(struct task* task, char** template, const char* line, int lineNumber, int keepOrder, int devNull)
+{
+	task->argv = buildArgs(template, line);
+	task->line = lineNumber;
+	task->outFD = keepOrder == 1 ? memfd_create("parallel", MFD_CLOEXEC) : -1;
+	task->finished = 0;
+
+	struct command command = {0};
+	for (command.argc = 0; task->argv[command.argc] != NULL; command.argc++);
+	command.argv = task->argv;
+
+	struct launch launch = {0};
+	launch.command = &command;
+	launch.inFD = devNull;
+	launch.outFD = task->outFD;
+	launch.pgid = getpgrp();
+	launch.terminalFD = -1;
+	launch.cgroupFD = -1;
+	launch.profileFD = -1;
+
+	// anything parallel has written must come before the command's output
+	fflush(stdout);
+	pid_t spawnPid = spawnStage(&launch);
+	if (spawnPid == -1)
+	{
+		task->finished = 1;
+		return -1;
+	}
+	setpgid(spawnPid, launch.pgid);
+
+	task->job = jobCreate(line, 0);
+	jobAddProcess(task->job, spawnPid);
+	return 0;
+}
+
+
+// Writes out the output a task kept in its memory file
+static void writeOutput(struct task* task)
+{
+	char buffer[65536];
+	ssize_t charsRead;
+
+	if (task->outFD == -1)
+	{
+		return;
+	}
+	lseek(task->outFD, 0, SEEK_SET);
+	while ((charsRead = read(task->outFD, buffer, sizeof(buffer))) > 0)
+	{
+		ssize_t charsWritten = 0;
+		while (charsWritten < charsRead)
+		{
+			ssize_t n = write(STDOUT_FILENO, buffer + charsWritten, charsRead - charsWritten);
+			if (n == -1 && errno != EINTR) return;
+			if (n > 0) charsWritten += n;
+		}
+	}
+}
+
+
+/* **********************************************************************************
+ ** Description: Built-in command parallel (see the top of this file). Reads input
+		 lines and starts a command for each one while fewer than N are
+		 running. When none can be started, it waits for a child to finish,
+		 collects the exit status of every command that has finished, and
+		 with -k writes out the output of the finished commands that are next
+		 in input order
+ ** Input(s): 	 The command, and pointer to the exit method of the last foreground
+		 process
+ ** Output(s): 	 Output of the commands, and a message if any of them failed
+ ** Returns: 	 The number of commands which failed (at most 101), or 2 if the
+		 command is not used properly
+ ** *******************************************************************************/
+int parallelBuiltin(struct command* command, int* childExitMethod)
+{
+	long maxRunning = sysconf(_SC_NPROCESSORS_ONLN);
+	int keepOrder = 0;
+	const char* inputFile = NULL;
+	int i;
+
+	// options come before the command
+	for (i = 1; i < command->argc && command->argv[i][0] == '-'; i++)
+	{
+		if (strncmp(command->argv[i], "-j", 2) == 0 && command->argv[i][2] != '\0')
+		{
+			maxRunning = atol(command->argv[i] + 2);
+		}
+		else if (strcmp(command->argv[i], "-j") == 0 && i + 1 < command->argc)
+		{
+			maxRunning = atol(command->argv[++i]);
+		}
+		else if (strcmp(command->argv[i], "-a") == 0 && i + 1 < command->argc)
+		{
+			inputFile = command->argv[++i];
+		}
+		else if (strcmp(command->argv[i], "-k") == 0)
+		{
+			keepOrder = 1;
+		}
+		else
+		{
+			break;
+		}
+	}
+	if (i == command->argc || maxRunning < 1)
+	{
+		fprintf(stderr, "USAGE: parallel [-j N] [-k] [-a file] command [args...]\n");
+		*childExitMethod = EXIT_METHOD(2);
+		return 2;
+	}
+	if (maxRunning > MAX_PARALLEL)
+	{
+		maxRunning = MAX_PARALLEL;
+	}
+	char** template = command->argv + i;
+
+	// the lines are read from a stream of parallel's own, so nothing the shell had
+	// buffered from stdin is read again
+	FILE* input = inputFile != NULL ? fopen(inputFile, "r") : fdopen(dup(STDIN_FILENO), "r");
+	if (input == NULL)
+	{
+		perror(inputFile != NULL ? inputFile : "parallel");
+		*childExitMethod = EXIT_METHOD(2);
+		return 2;
+	}
+	int devNull = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+	struct task* tasks = calloc(maxRunning, sizeof(struct task));
+	int used = 0;			// slots holding a task
+	int started = 0;		// input lines read
+	int written = 0;		// input lines whose output has been written (-k)
+	int failed = 0;			// commands which did not exit with 0
+	int moreInput = 1;
+	char* line = NULL;
+	size_t lineSize = 0;
+
+	while (1)
+	{
+		// start a command for each input line while there is a free slot
+		while (moreInput == 1 && used < maxRunning)
+		{
+			ssize_t lineLength = getline(&line, &lineSize, input);
+			if (lineLength == -1)
+			{
+				moreInput = 0;
+				break;
+			}
+			if (lineLength > 0 && line[lineLength - 1] == '\n')
+			{
+				line[lineLength - 1] = '\0';
+			}
+
+			for (i = 0; tasks[i].job != NULL || tasks[i].finished == 1; i++);
+			used++;
+			if (startTask(&tasks[i], template, line, started++, keepOrder, devNull) == -1)
+			{
+				failed++;
+				if (keepOrder == 0)
+				{
+					freeTask(&tasks[i]);
+					used--;
+				}
+			}
+		}
+
+		// with -k, write the output of finished commands for as long as the next line in
+		// order has finished
+		int progress = keepOrder;
+		while (progress == 1)
+		{
+			progress = 0;
+			for (i = 0; i < maxRunning; i++)
+			{
+				if (tasks[i].finished == 1 && tasks[i].line == written)
+				{
+					writeOutput(&tasks[i]);
+					freeTask(&tasks[i]);
+					used--;
+					written++;
+					progress = 1;
+				}
+			}
+		}
+		if (used == 0)
+		{
+			break;
+		}
+
+		// sleep until a command finishes, then collect every one that has
+		if (waitChild() == -1)
+		{
+			break;
+		}
+		for (i = 0; i < maxRunning; i++)
+		{
+			struct task* task = &tasks[i];
+			if (task->job == NULL || task->finished == 1 || task->job->remaining > 0)
+			{
+				continue;
+			}
+			if (task->job->exitMethod != 0)
+			{
+				failed++;
+			}
+			jobRemove(task->job);
+			task->finished = 1;
+			if (keepOrder == 0)
+			{
+				freeTask(task);
+				used--;
+			}
+		}
+	}
+
+	// only a stopped command can still hold a slot
+	for (i = 0; i < maxRunning; i++)
+	{
+		if (tasks[i].job != NULL || tasks[i].finished == 1)
+		{
+			freeTask(&tasks[i]);
+		}
+	}
+	free(line);
+	free(tasks);
+	fclose(input);
+	close(devNull);
+
+	if (failed > 0)
+	{
+		fprintf(stderr, "parallel: %d of %d commands failed\n", failed, started);
+	}
+	fflush(stdout);
+	*childExitMethod = EXIT_METHOD(failed > 101 ? 101 : failed);
+	return failed > 101 ? 101 : failed;
+}
@@ -0,0 +1,807 @@
+/* **********************************************************************************
+ ** Program Name:   Program 3 - smallsh (parse_smallsh.c)
+ ** Author:         Susan Hibbert
+ ** Date:           20th May 2020
+ ** Description:    Lexer and parser for the smallsh program. A command line is read
+		    once from start to end, and turned into a pipeline of commands
+		    (see smallsh.h). All memory for the pipeline comes from an arena
+		    which is reset before each line, so nothing is malloc'd per word
+ ** *******************************************************************************/
+#include "smallsh.h"
+
+// types of token produced by the lexer
+#define TOKEN_WORD 0		// a command name, argument or file name
+#define TOKEN_REDIRECT 1	// a redirection operator, optionally after a file descriptor
+#define TOKEN_SUBSTITUTE 2	// a process substitution, <(pipeline) or >(pipeline)
+#define TOKEN_PIPE 3		// |
+#define TOKEN_AMP 4		// & at the end of the line
+#define TOKEN_END 5		// end of the line, or the start of a comment
+
+// redirection operators, longest first so that the lexer matches the whole operator
+static const char* operators[] = { "&>>", "<<<", "&>", ">>", ">&", "<&", "<", ">" };
+
+struct token
+{
+	int type;
+	char* text;			// the word, with parameters expanded (TOKEN_WORD), the
+					// operator (TOKEN_REDIRECT), or the substitution's
+					// pipeline, NULL if it has no ) (TOKEN_SUBSTITUTE)
+	size_t length;			// length of the word
+	int fd;				// file descriptor before the operator, -1 if none was given,
+					// or 1 for >(pipeline) and 0 for <(pipeline)
+};
+
+// one of the words of the command being parsed
+struct word
+{
+	char* text;
+	struct word* next;
+};
+
+// position of the lexer in the line being parsed
+struct lexer
+{
+	const char* pos;		// next character to be read
+	struct arena* arena;		// where words are copied to
+	const struct specials* specials;	// values of $$, $? and $!
+	char number[24];		// $? or $! written out as a string
+};
+
+extern char** environ;
+
+
+// Adds a chunk of at least the given size to an arena, after its current chunk, and makes
+// it the current chunk. Returns NULL if it cannot be allocated
+static struct arenaChunk* arenaAddChunk(struct arena* arena, size_t size)
+{
+	struct arenaChunk* chunk = malloc(sizeof(struct arenaChunk) + size);
+	if (chunk == NULL)
+	{
+		return NULL;
+	}
+	chunk->size = size;
+	chunk->used = 0;
+	if (arena->current == NULL)
+	{
+		chunk->next = NULL;
+		arena->first = chunk;
+	}
+	else
+	{
+		chunk->next = arena->current->next;
+		arena->current->next = chunk;
+	}
+	arena->current = chunk;
+	return chunk;
+}
+
+
+/* **********************************************************************************
+ ** Description: Sets up an arena - memory that the parser hands out in pieces, from
+		 a list of chunks. When the current chunk is full the next one is
+		 used, and a chunk twice the size is added once there are no more.
+		 Chunks are kept when the arena is reset, so once the arena has grown
+		 to fit the longest line, no more memory is allocated
+ ** Input(s): 	 The arena and the size of its first chunk in bytes
+ ** Output(s): 	 Exits with an error message if the chunk cannot be allocated
+ ** Returns: 	 No return value
+ ** *******************************************************************************/
+void arenaInit(struct arena* arena, size_t size)
+{
+	arena->first = NULL;
+	arena->current = NULL;
+	arena->listings = NULL;
+	if (arenaAddChunk(arena, size) == NULL)
+	{
+		perror("Unable to allocate memory for the parser\n");
+		exit(1);
+	}
+}
+
+
+// Hands the whole arena back, ready for the next line. The directory listings kept for
+// filename expansion go with it
+void arenaReset(struct arena* arena)
+{
+	struct arenaChunk* chunk;
+	for (chunk = arena->first; chunk != NULL; chunk = chunk->next)
+	{
+		chunk->used = 0;
+	}
+	arena->current = arena->first;
+	arena->listings = NULL;
+}
+
+
+/* **********************************************************************************
+ ** Description: Finds room for the given number of bytes at the end of the arena,
+		 aligned for any type, moving on to a later chunk (or adding one) if
+		 the current chunk is too full. The room is not handed out until
+		 arenaCommit is called, so a word can be written into it before its
+		 length is known
+ ** Input(s): 	 The arena and the number of bytes needed
+ ** Output(s): 	 No output
+ ** Returns: 	 The start of the room, or NULL if memory cannot be allocated
+ ** *******************************************************************************/
+void* arenaReserve(struct arena* arena, size_t bytes)
+{
+	struct arenaChunk* chunk = arena->current;
+	size_t start = (chunk->used + 15) & ~(size_t)15;
+
+	while (start + bytes > chunk->size)
+	{
+		// the chunks after the current one are empty - use the next if it is big enough,
+		// otherwise add a bigger one in front of it
+		if (chunk->next != NULL && chunk->next->size >= bytes)
+		{
+			chunk = chunk->next;
+			arena->current = chunk;
+		}
+		else if ((chunk = arenaAddChunk(arena, chunk->size * 2 > bytes ? chunk->size * 2 : bytes)) == NULL)
+		{
+			return NULL;
+		}
+		start = 0;
+	}
+	return chunk->data + start;
+}
+
+
+// Hands out bytes from the start of the room found by arenaReserve
+void arenaCommit(struct arena* arena, void* start, size_t bytes)
+{
+	arena->current->used = ((char*)start - arena->current->data) + bytes;
+}
+
+
+// Hands out the given number of bytes from the arena, aligned for any type. Returns NULL
+// if memory cannot be allocated
+void* arenaAlloc(struct arena* arena, size_t bytes)
+{
+	void* start = arenaReserve(arena, bytes);
+	if (start != NULL)
+	{
+		arenaCommit(arena, start, bytes);
+	}
+	return start;
+}
+
+
+// Checks whether a character ends a word
+static int endsWord(char c)
+{
+	return c == '\0' || c == ' ' || c == '\t' || c == '\n' || c == '<' || c == '>' || c == '|';
+}
+
+
+// Checks whether a character can be part of a variable name
+static int isNameChar(char c)
+{
+	return c == '_' || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9');
+}
+
+
+/* **********************************************************************************
+ ** Description: Expands the parameter after a $ in a word - $$ (the shell's process
+		 ID), $? (the exit value of the last foreground command), $! (the
+		 process ID of the last background job), or an environment variable
+		 named as $NAME or ${NAME}. Variables are looked up in the environment
+		 in place, so the name does not have to be copied out of the line
+ ** Input(s): 	 The lexer, pointer to the $ in the line, and pointer to where the
+		 length of the value is returned
+ ** Output(s): 	 No output
+ ** Returns: 	 The value (an empty string for a variable that is not set), with *c
+		 moved past the parameter, or NULL if the $ does not start a parameter
+ ** *******************************************************************************/
+static const char* expandParameter(struct lexer* lexer, const char** c, size_t* valueLength)
+{
+	const char* name = *c + 1;
+	const char* nameEnd;
+	char** var;
+
+	switch (*name)
+	{
+		case '$':
+			*c = name + 1;
+			*valueLength = lexer->specials->pidLength;
+			return lexer->specials->pid;
+		case '?':
+			*c = name + 1;
+			*valueLength = sprintf(lexer->number, "%d", exitValue(lexer->specials->exitMethod));
+			return lexer->number;
+		case '!':
+			*c = name + 1;
+			*valueLength = lexer->specials->lastBackground > 0 ?
+				sprintf(lexer->number, "%ld", (long)lexer->specials->lastBackground) : 0;
+			return lexer->number;
+	}
+
+	// $NAME runs to the first character which cannot be in a name, ${NAME} to the }
+	int braced = *name == '{';
+	if (braced == 1)
+	{
+		name++;
+	}
+	if (isNameChar(*name) == 0 || (*name >= '0' && *name <= '9'))
+	{
+		return NULL;
+	}
+	for (nameEnd = name; isNameChar(*nameEnd); nameEnd++);
+	if (braced == 1 && *nameEnd != '}')
+	{
+		return NULL;
+	}
+	*c = nameEnd + braced;
+
+	size_t nameLength = nameEnd - name;
+	for (var = environ; *var != NULL; var++)
+	{
+		if (strncmp(*var, name, nameLength) == 0 && (*var)[nameLength] == '=')
+		{
+			*valueLength = strlen(*var + nameLength + 1);
+			return *var + nameLength + 1;
+		}
+	}
+	*valueLength = 0;
+	return "";
+}
+
+
+// Reads a process substitution, <(pipeline) or >(pipeline), whose pipeline runs to the
+// matching ), and copies the pipeline into the arena. Returns 0, or -1 if memory cannot be
+// allocated
+static int readSubstitution(struct lexer* lexer, struct token* token, const char* c)
+{
+	const char* start = c + 2;
+	const char* end;
+	int depth = 1;
+
+	for (end = start; *end != '\0'; end++)
+	{
+		if (*end == '(')
+		{
+			depth++;
+		}
+		else if (*end == ')' && --depth == 0)
+		{
+			break;
+		}
+	}
+
+	token->type = TOKEN_SUBSTITUTE;
+	token->fd = *c == '>';
+	token->text = NULL;
+	token->length = end - start;
+	lexer->pos = end;
+	if (*end == '\0')
+	{
+		return 0;
+	}
+	token->text = arenaAlloc(lexer->arena, token->length + 1);
+	if (token->text == NULL)
+	{
+		return -1;
+	}
+	memcpy(token->text, start, token->length);
+	token->text[token->length] = '\0';
+	lexer->pos = end + 1;
+	return 0;
+}
+
+
+/* **********************************************************************************
+ ** Description: Reads the next token from the line. Words are separated by spaces,
+		 and by the <, > and | operators. An & is only an operator when it is
+		 the last thing on the line, otherwise it is part of a word. A word
+		 beginning with # starts a comment, which runs to the end of the line.
+		 <( or >( starts a process substitution (see readSubstitution).
+		 Words are written straight into the free end of the arena, with each
+		 parameter ($$, $?, $!, $NAME, ${NAME}) expanded wherever it is in the
+		 word. A word which expands to nothing is left out
+ ** Input(s): 	 The lexer and the token to fill in
+ ** Output(s): 	 No output
+ ** Returns: 	 Returns 0, or -1 if memory cannot be allocated
+ ** *******************************************************************************/
+static int nextToken(struct lexer* lexer, struct token* token)
+{
+	const char* c = lexer->pos;
+
+	// skip the space before the token
+	while (*c == ' ' || *c == '\t' || *c == '\n')
+	{
+		c++;
+	}
+	token->text = NULL;
+
+	if (*c == '\0' || *c == '#')
+	{
+		token->type = TOKEN_END;
+		lexer->pos = c;
+		return 0;
+	}
+	if (*c == '|')
+	{
+		token->type = TOKEN_PIPE;
+		lexer->pos = c + 1;
+		return 0;
+	}
+
+	if ((*c == '<' || *c == '>') && c[1] == '(')
+	{
+		return readSubstitution(lexer, token, c);
+	}
+
+	// a redirection operator may follow a single digit file descriptor, with no space
+	// between them
+	token->fd = -1;
+	const char* op = c;
+	if (*c >= '0' && *c <= '9' && (c[1] == '<' || c[1] == '>'))
+	{
+		token->fd = *c - '0';
+		op = c + 1;
+	}
+	if (*op == '<' || *op == '>' || (*op == '&' && op[1] == '>' && token->fd == -1))
+	{
+		int i;
+		for (i = 0; strncmp(op, operators[i], strlen(operators[i])) != 0; i++);
+		token->type = TOKEN_REDIRECT;
+		token->text = (char*)operators[i];
+		lexer->pos = op + strlen(operators[i]);
+		return 0;
+	}
+	if (*c == '&')
+	{
+		// only space may follow a background &
+		const char* after = c + 1;
+		while (*after == ' ' || *after == '\t' || *after == '\n')
+		{
+			after++;
+		}
+		if (*after == '\0')
+		{
+			token->type = TOKEN_AMP;
+			lexer->pos = after;
+			return 0;
+		}
+	}
+
+	// copy the word to the end of the arena, which is only handed out once the word is
+	// complete and its length is known. If it outgrows the room, it moves to room twice
+	// the size
+	struct arena* arena = lexer->arena;
+	char* word = NULL;
+	size_t length = 0;
+	size_t room = 0;
+	int expanded = 0;
+
+	while (endsWord(*c) == 0)
+	{
+		const char* value = NULL;
+		size_t valueLength = 1;
+		if (*c == '$')
+		{
+			value = expandParameter(lexer, &c, &valueLength);
+		}
+		if (value == NULL)
+		{
+			value = c++;
+			valueLength = 1;
+		}
+		else
+		{
+			expanded = 1;
+		}
+
+		// leave room for the '\0'
+		if (length + valueLength >= room)
+		{
+			room = (length + valueLength + 1) * 2 > 64 ? (length + valueLength + 1) * 2 : 64;
+			char* bigger = arenaReserve(arena, room);
+			if (bigger == NULL)
+			{
+				return -1;
+			}
+			if (bigger != word && length > 0)
+			{
+				memcpy(bigger, word, length);
+			}
+			word = bigger;
+		}
+		memcpy(word + length, value, valueLength);
+		length += valueLength;
+	}
+	lexer->pos = c;
+
+	if (length == 0 && expanded == 1)
+	{
+		return nextToken(lexer, token);
+	}
+	word[length] = '\0';
+	arenaCommit(arena, word, length + 1);
+
+	token->type = TOKEN_WORD;
+	token->text = word;
+	token->length = length;
+	return 0;
+}
+
+
+// Returns a printable name for a token, for syntax error messages
+static const char* tokenName(struct token* token)
+{
+	switch (token->type)
+	{
+		case TOKEN_PIPE: return "|";
+		case TOKEN_AMP: return "&";
+		case TOKEN_END: return "newline";
+		case TOKEN_SUBSTITUTE: return token->fd == 1 ? ">(" : "<(";
+		default: return token->text;
+	}
+}
+
+
+// Adds a redirection to the end of a command's list. Returns NULL if memory cannot be
+// allocated
+static struct redirect* addRedirect(struct arena* arena, struct redirect*** nextRedirect, int fd, int type)
+{
+	struct redirect* redirect = arenaAlloc(arena, sizeof(struct redirect));
+	if (redirect != NULL)
+	{
+		memset(redirect, 0, sizeof(struct redirect));
+		redirect->fd = fd;
+		redirect->type = type;
+		**nextRedirect = redirect;
+		*nextRedirect = &redirect->next;
+	}
+	return redirect;
+}
+
+
+/* **********************************************************************************
+ ** Description: Parses the pipeline of a process substitution, in the same arena as
+		 the line it is part of, and adds the substitution to the end of the
+		 command's list. The pipeline may hold process substitutions of its own
+ ** Input(s): 	 The lexer, the substitution token, the arena, where the next
+		 substitution goes in the command's list, and where the new
+		 substitution is returned
+ ** Output(s): 	 Displays an error message if the pipeline cannot be parsed
+ ** Returns: 	 Returns 0, -1 if the pipeline is wrong, or -2 if memory cannot be
+		 allocated
+ ** *******************************************************************************/
+static int parseSubstitution(struct lexer* lexer, struct token* token, struct arena* arena,
+			     struct substitution*** nextSubstitution, struct substitution** added)
+{
+	if (token->text == NULL)
+	{
+		fprintf(stderr, "smallsh: syntax error: missing ')'\n");
+		return -1;
+	}
+
+	struct substitution* substitution = arenaAlloc(arena, sizeof(struct substitution));
+	if (substitution == NULL)
+	{
+		return -2;
+	}
+	memset(substitution, 0, sizeof(struct substitution));
+	substitution->output = token->fd;
+	substitution->text = token->text;
+	substitution->fd = -1;
+
+	// errors in the pipeline have already been reported
+	substitution->pipeline = parseLine(arena, token->text, lexer->specials);
+	if (substitution->pipeline == NULL)
+	{
+		return -1;
+	}
+	if (substitution->pipeline->first == NULL)
+	{
+		fprintf(stderr, "smallsh: syntax error near ')'\n");
+		return -1;
+	}
+
+	**nextSubstitution = substitution;
+	*nextSubstitution = &substitution->next;
+	*added = substitution;
+	return 0;
+}
+
+
+/* **********************************************************************************
+ ** Description: Parses a redirection - the operator and the word after it - into
+		 operations on file descriptors, added to the command's list:
+		 [n]< file	open file for reading on n (default 0)
+		 [n]> file	create or truncate file for writing on n (default 1)
+		 [n]>> file	create file or append to it on n (default 1)
+		 [n]>&m [n]<&m	copy file descriptor m onto n (default 1 and 0)
+		 [n]>&- [n]<&-	close n
+		 &> file	file on 1, then 1 copied onto 2 (&>> appends)
+		 [n]<<< word	the word and a newline on n (default 0)
+		 A file may be a process substitution, such as < <(pipeline)
+ ** Input(s): 	 The lexer, the operator token, the arena, and where the next
+		 redirection and process substitution go in the command's lists
+ ** Output(s): 	 Displays an error message if the word is missing or not a file
+		 descriptor
+ ** Returns: 	 Returns 0, -1 if the redirection is wrong, or -2 if memory cannot be
+		 allocated
+ ** *******************************************************************************/
+static int parseRedirect(struct lexer* lexer, struct token* token, struct arena* arena, struct redirect*** nextRedirect,
+			 struct substitution*** nextSubstitution)
+{
+	const char* op = token->text;
+	int fd = token->fd != -1 ? token->fd : (op[0] == '<' ? 0 : 1);
+	struct redirect* redirect;
+
+	// the file name (or file descriptor, or here-string) must follow the operator
+	if (nextToken(lexer, token) < 0)
+	{
+		return -2;
+	}
+	if (token->type == TOKEN_SUBSTITUTE && op[strlen(op) - 1] != '&' && strcmp(op, "<<<") != 0)
+	{
+		// the file is the substitution's pipe, named once it is started
+		struct substitution* substitution;
+		int result = parseSubstitution(lexer, token, arena, nextSubstitution, &substitution);
+		if (result != 0)
+		{
+			return result;
+		}
+		token->type = TOKEN_WORD;
+		token->text = substitution->path;
+	}
+	if (token->type != TOKEN_WORD)
+	{
+		fprintf(stderr, "smallsh: syntax error near '%s'\n", tokenName(token));
+		return -1;
+	}
+
+	if (strcmp(op, ">&") == 0 || strcmp(op, "<&") == 0)
+	{
+		char* end;
+		long sourceFD = strtol(token->text, &end, 10);
+		if (strcmp(token->text, "-") == 0)
+		{
+			return addRedirect(arena, nextRedirect, fd, REDIRECT_CLOSE) != NULL ? 0 : -2;
+		}
+		if (*end != '\0' || end == token->text || sourceFD < 0 || sourceFD > INT_MAX)
+		{
+			fprintf(stderr, "smallsh: %s: bad file descriptor\n", token->text);
+			return -1;
+		}
+		if ((redirect = addRedirect(arena, nextRedirect, fd, REDIRECT_DUP)) == NULL)
+		{
+			return -2;
+		}
+		redirect->sourceFD = sourceFD;
+		return 0;
+	}
+
+	int type = strcmp(op, "<<<") == 0 ? REDIRECT_STRING : REDIRECT_FILE;
+	if ((redirect = addRedirect(arena, nextRedirect, fd, type)) == NULL)
+	{
+		return -2;
+	}
+	redirect->path = token->text;
+	if (op[0] == '<')
+	{
+		redirect->flags = O_RDONLY;
+	}
+	else if (strcmp(op, ">>") == 0 || strcmp(op, "&>>") == 0)
+	{
+		redirect->flags = O_WRONLY | O_CREAT | O_APPEND;
+	}
+	else
+	{
+		redirect->flags = O_WRONLY | O_CREAT | O_TRUNC;
+	}
+
+	// &> sends stderr wherever stdout now goes
+	if (op[0] == '&')
+	{
+		if ((redirect = addRedirect(arena, nextRedirect, 2, REDIRECT_DUP)) == NULL)
+		{
+			return -2;
+		}
+		redirect->sourceFD = 1;
+	}
+	return 0;
+}
+
+
+/* **********************************************************************************
+ ** Description: Parses a command line into a pipeline in a single pass, taking each
+		 token from the lexer as it is needed. A command is a run of words and
+		 redirections (see parseRedirect), commands are joined by |, and the line
+		 may end with & to run the pipeline in the background. The line may
+		 start with time, to report what the pipeline cost, and with profile,
+		 to count its cycles and cache misses (in either order). A process
+		 substitution in place of a word is parsed as a pipeline of its own
+		 (see parseSubstitution), and the word becomes the name of its pipe
+ ** Input(s): 	 The arena to build the pipeline in, the command line and the values
+		 of the shell's special parameters
+ ** Output(s): 	 Displays an error message if the line cannot be parsed
+ ** Returns: 	 The pipeline (with no commands for a blank line or comment), or NULL
+		 if there was an error
+ ** *******************************************************************************/
+struct pipeline* parseLine(struct arena* arena, const char* line, const struct specials* specials)
+{
+	struct lexer lexer;
+	struct token token;
+	long argMax = sysconf(_SC_ARG_MAX);	// most bytes of arguments a command can be given
+
+	lexer.pos = line;
+	lexer.arena = arena;
+	lexer.specials = specials;
+
+	struct pipeline* pipeline = arenaAlloc(arena, sizeof(struct pipeline));
+	if (pipeline == NULL || nextToken(&lexer, &token) < 0)
+	{
+		goto full;
+	}
+	pipeline->first = NULL;
+	pipeline->numCommands = 0;
+	pipeline->background = 0;
+	pipeline->timed = 0;
+	pipeline->profiled = 0;
+
+	// the keyword time before a pipeline has the shell time it, and profile has the shell
+	// count its hardware events (see profile_smallsh.c)
+	while (token.type == TOKEN_WORD && ((strcmp(token.text, "time") == 0 && pipeline->timed == 0) ||
+					    (strcmp(token.text, "profile") == 0 && pipeline->profiled == 0)))
+	{
+		if (token.text[0] == 't') pipeline->timed = 1;
+		else pipeline->profiled = 1;
+		if (nextToken(&lexer, &token) < 0)
+		{
+			goto full;
+		}
+	}
+
+	// a blank line or a comment has no commands
+	if (token.type == TOKEN_END)
+	{
+		return pipeline;
+	}
+
+	struct command** nextCommand = &pipeline->first;
+	while (1)
+	{
+		struct command* command = arenaAlloc(arena, sizeof(struct command));
+		if (command == NULL)
+		{
+			goto full;
+		}
+		struct redirect** nextRedirect = &command->redirects;
+		struct substitution** nextSubstitution = &command->substitutions;
+		struct word* words = NULL;	// the command's words, last first
+		int numWords = 0;
+		size_t argBytes = 0;		// bytes execve needs for the words
+
+		// collect the command's words and redirections
+		while (token.type == TOKEN_WORD || token.type == TOKEN_REDIRECT || token.type == TOKEN_SUBSTITUTE)
+		{
+			if (token.type == TOKEN_SUBSTITUTE)
+			{
+				struct substitution* substitution;
+				int result = parseSubstitution(&lexer, &token, arena, &nextSubstitution, &substitution);
+				if (result == -2)
+				{
+					goto full;
+				}
+				if (result == -1)
+				{
+					return NULL;
+				}
+				token.type = TOKEN_WORD;
+				token.text = substitution->path;
+				token.length = sizeof(substitution->path) - 1;
+			}
+
+			if (token.type == TOKEN_WORD)
+			{
+				// a word holding a pattern is replaced by the names it matches, if any
+				char** matches = &token.text;
+				int numMatches = 1;
+				if (globHasPattern(token.text) == 1)
+				{
+					numMatches = globExpand(arena, token.text, &matches);
+					if (numMatches == -1)
+					{
+						goto full;
+					}
+					if (numMatches == 0)
+					{
+						matches = &token.text;
+						numMatches = 1;
+					}
+				}
+
+				int i;
+				for (i = 0; i < numMatches; i++)
+				{
+					struct word* word = arenaAlloc(arena, sizeof(struct word));
+					if (word == NULL)
+					{
+						goto full;
+					}
+					word->text = matches[i];
+					word->next = words;
+					words = word;
+					numWords++;
+
+					// each argument costs its characters, its '\0' and its pointer
+					argBytes += strlen(matches[i]) + 1 + sizeof(char*);
+					if (argMax > 0 && argBytes > (size_t)argMax)
+					{
+						fprintf(stderr, "smallsh: argument list too long\n");
+						return NULL;
+					}
+				}
+			}
+			else
+			{
+				int result = parseRedirect(&lexer, &token, arena, &nextRedirect, &nextSubstitution);
+				if (result == -2)
+				{
+					goto full;
+				}
+				if (result == -1)
+				{
+					return NULL;
+				}
+			}
+
+			if (nextToken(&lexer, &token) < 0)
+			{
+				goto full;
+			}
+		}
+		*nextRedirect = NULL;
+		*nextSubstitution = NULL;
+
+		if (numWords == 0)
+		{
+			fprintf(stderr, "smallsh: syntax error near '%s'\n", tokenName(&token));
+			return NULL;
+		}
+
+		// copy the arguments into the arena, now that we know how many there are
+		command->argv = arenaAlloc(arena, (numWords + 1) * sizeof(char*));
+		if (command->argv == NULL)
+		{
+			goto full;
+		}
+		command->argv[numWords] = NULL;
+		int i;
+		for (i = numWords - 1; i >= 0; i--)
+		{
+			command->argv[i] = words->text;
+			words = words->next;
+		}
+		command->argc = numWords;
+		command->next = NULL;
+
+		*nextCommand = command;
+		nextCommand = &command->next;
+		pipeline->numCommands++;
+
+		// a | is followed by the next command, anything else ends the line
+		if (token.type != TOKEN_PIPE)
+		{
+			break;
+		}
+		if (nextToken(&lexer, &token) < 0)
+		{
+			goto full;
+		}
+	}
+
+	if (token.type == TOKEN_AMP)
+	{
+		pipeline->background = 1;
+	}
+	return pipeline;
+
+full:
+	fprintf(stderr, "smallsh: out of memory\n");
+	return NULL;
+}
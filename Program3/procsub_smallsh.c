@@ -0,0 +1,219 @@
+/* **********************************************************************************
+ ** Program Name:   Program 3 - smallsh (procsub_smallsh.c)
+ ** Author:         Susan Hibbert
+ ** Date:           20th May 2020
+ ** Description:    Process substitution and coprocesses for the smallsh program.
+		    <(pipeline) and >(pipeline) in a command are replaced by the name
+		    of a pipe, /dev/fd/N, whose other end is joined to the pipeline,
+		    so the command and the pipeline run at the same time and nothing
+		    is written to disk. The coproc built-in command starts a command
+		    in the background joined to the shell by a pipe in each direction.
+
+		    USAGE: coproc command [args...]
+			   coproc -c
+
+		    The shell's ends of the coprocess's pipes are kept open, and their
+		    file descriptors are put in COPROC_READ and COPROC_WRITE (with its
+		    pid in COPROC_PID), to be used with redirections such as
+		    >&$COPROC_WRITE. coproc -c closes the shell's end of the pipe to the
+		    coprocess, so that it reads end of file
+ ** *******************************************************************************/
+#include "smallsh.h"
+
+// the shell's ends of the pipes of the last coprocess started: [0] reads what it writes,
+// [1] writes to its stdin. -1 once closed
+static int coprocFDs[2] = { -1, -1 };
+
+
+// Moves a file descriptor above those a redirection can change, so that the command's own
+// redirections cannot close it. Returns the new file descriptor, or -1
+static int moveAbove(int fd)
+{
+	int moved = fcntl(fd, F_DUPFD_CLOEXEC, MAX_REDIRECT_FD + 1);
+	close(fd);
+	return moved;
+}
+
+
+/* **********************************************************************************
+ ** Description: Starts the process substitutions of a command, just before it is
+		 started. Each substitution's pipeline is run as a job of its own,
+		 which the shell does not wait for, and which is removed from the
+		 table without a message when it finishes. The end of the pipeline
+		 not joined to the pipe is left on the shell's stdin or stdout. The
+		 shell keeps its end of each pipe open until the command has started
+		 (see closeSubstitutions), and the command is given its name as
+		 /dev/fd/N
+ ** Input(s): 	 The command, and the exit method of the last foreground process
+ ** Output(s): 	 Error messages are displayed if a pipeline cannot be run
+ ** Returns: 	 Returns 0, or -1 if a substitution could not be started (those
+		 already started are then closed)
+ ** *******************************************************************************/
+int startSubstitutions(struct command* command, int childExitMethod)
+{
+	struct substitution* substitution;
+
+	for (substitution = command->substitutions; substitution != NULL; substitution = substitution->next)
+	{
+		substitution->fd = -1;
+	}
+
+	for (substitution = command->substitutions; substitution != NULL; substitution = substitution->next)
+	{
+		int pipeFDs[2];
+		if (pipe2(pipeFDs, O_CLOEXEC) == -1)
+		{
+			perror("Unable to create pipe\n");
+			fflush(stderr);		// flush output buffers after printing
+			closeSubstitutions(command);
+			return -1;
+		}
+
+		// <(pipeline) writes into the pipe and the command reads from it, >(pipeline) reads
+		// what the command writes
+		int output = substitution->output;
+		struct job* job = startJob(substitution->pipeline, substitution->text, output == 1 ? pipeFDs[0] : -1,
+					   output == 1 ? -1 : pipeFDs[1], 0, 0, childExitMethod);
+		close(pipeFDs[output == 1 ? 0 : 1]);
+		substitution->fd = moveAbove(pipeFDs[output == 1 ? 1 : 0]);
+		if (job == NULL || substitution->fd == -1)
+		{
+			closeSubstitutions(command);
+			return -1;
+		}
+		job->quiet = 1;
+		snprintf(substitution->path, sizeof(substitution->path), "/dev/fd/%d", substitution->fd);
+	}
+	return 0;
+}
+
+
+// Closes the shell's ends of a command's process substitution pipes, once the command has
+// its own copies
+void closeSubstitutions(struct command* command)
+{
+	struct substitution* substitution;
+	for (substitution = command->substitutions; substitution != NULL; substitution = substitution->next)
+	{
+		if (substitution->fd != -1)
+		{
+			close(substitution->fd);
+			substitution->fd = -1;
+		}
+	}
+}
+
+
+// Sets an environment variable to a number
+static void setNumber(const char* name, long value)
+{
+	char number[24];
+	sprintf(number, "%ld", value);
+	setenv(name, number, 1);
+}
+
+
+/* **********************************************************************************
+ ** Description: Built-in command coproc (see the top of this file). Starts the
+		 command as a background job whose stdin and stdout are pipes to the
+		 shell. A new coprocess replaces the last one as the one named by the
+		 COPROC variables - the last one keeps running until the shell's end
+		 of its stdin is closed
+ ** Input(s): 	 The command, and pointer to the exit method of the last foreground
+		 process
+ ** Output(s): 	 Displays the pid of the coprocess when it begins, or an error message
+ ** Returns: 	 Returns 0, 1 if the coprocess could not be started, or 2 if the
+		 command is not used properly
+ ** *******************************************************************************/
+int coprocBuiltin(struct command* command, int* childExitMethod)
+{
+	if (command->argc == 2 && strcmp(command->argv[1], "-c") == 0)
+	{
+		if (coprocFDs[1] != -1)
+		{
+			close(coprocFDs[1]);
+			coprocFDs[1] = -1;
+			unsetenv("COPROC_WRITE");
+		}
+		*childExitMethod = 0;
+		return 0;
+	}
+	if (command->argc < 2 || command->argv[1][0] == '-')
+	{
+		fprintf(stderr, "USAGE: coproc command [args...]\n       coproc -c\n");
+		*childExitMethod = EXIT_METHOD(2);
+		return 2;
+	}
+
+	int toCoproc[2];
+	int fromCoproc[2];
+	if (pipe2(toCoproc, O_CLOEXEC) == -1)
+	{
+		perror("Unable to create pipe\n");
+		*childExitMethod = EXIT_METHOD(1);
+		return 1;
+	}
+	if (pipe2(fromCoproc, O_CLOEXEC) == -1)
+	{
+		perror("Unable to create pipe\n");
+		close(toCoproc[0]);
+		close(toCoproc[1]);
+		*childExitMethod = EXIT_METHOD(1);
+		return 1;
+	}
+
+	// the coprocess is the command after coproc. Its redirections have already been
+	// applied to the shell, and are passed on with the shell's file descriptors
+	struct command coprocCommand = {0};
+	coprocCommand.argv = command->argv + 1;
+	coprocCommand.argc = command->argc - 1;
+	struct pipeline pipeline = {0};
+	pipeline.first = &coprocCommand;
+	pipeline.numCommands = 1;
+	pipeline.background = 1;
+
+	// the job table shows the command line without coproc
+	size_t length = 0;
+	int i;
+	for (i = 1; i < command->argc; i++)
+	{
+		length += strlen(command->argv[i]) + 1;
+	}
+	char* text = malloc(length);
+	char* end = text;
+	for (i = 1; i < command->argc; i++)
+	{
+		end = stpcpy(end, command->argv[i]);
+		*end++ = ' ';
+	}
+	end[-1] = '\0';
+
+	fflush(stdout);
+	struct job* job = startJob(&pipeline, text, toCoproc[0], fromCoproc[1], 1, 0, *childExitMethod);
+	free(text);
+	close(toCoproc[0]);
+	close(fromCoproc[1]);
+	if (job == NULL)
+	{
+		close(toCoproc[1]);
+		close(fromCoproc[0]);
+		*childExitMethod = EXIT_METHOD(1);
+		return 1;
+	}
+
+	// the last coprocess's pipes are closed, and the new ones kept where redirections
+	// cannot reach them
+	if (coprocFDs[0] != -1) close(coprocFDs[0]);
+	if (coprocFDs[1] != -1) close(coprocFDs[1]);
+	coprocFDs[0] = moveAbove(fromCoproc[0]);
+	coprocFDs[1] = moveAbove(toCoproc[1]);
+	setNumber("COPROC_READ", coprocFDs[0]);
+	setNumber("COPROC_WRITE", coprocFDs[1]);
+	setNumber("COPROC_PID", job->pgid);
+
+	lastBackgroundPid = job->pgid;
+	printf("background pid is %d\n", job->pgid);
+	fflush(stdout);		// flush output buffers after printing
+	*childExitMethod = 0;
+	return 0;
+}
@@ -0,0 +1,353 @@
+/* **********************************************************************************
+ ** Program Name:   Program 3 - smallsh (profile_smallsh.c)
+ ** Author:         Susan Hibbert
+ ** Date:           20th May 2020
+ ** Description:    Hardware event counters for the smallsh program. A line beginning
+		    with the keyword profile has each of its commands counted with
+		    perf_event_open - CPU cycles, instructions, cache references and
+		    misses, and context switches - and the totals are printed to
+		    stderr when the job finishes, with its instructions per cycle and
+		    the share of cache references that missed.
+
+		    USAGE: profile [time] pipeline
+
+		    Each child opens its own counters as soon as it starts, with
+		    inherit set so that any processes it starts are counted too, and
+		    enable_on_exec so that counting begins with the command itself.
+		    A built-in command run in a copy of the shell never executes, so
+		    its counters are enabled straight away. The counters are passed
+		    back to the shell over a socket, which reads them once the job has
+		    finished. A built-in command run by the shell itself is counted in
+		    the shell.
+
+		    Where perf events are restricted (kernel.perf_event_paranoid) only
+		    user-space events are counted, and where they are not available at
+		    all the job still runs, and the reason is printed instead
+ ** *******************************************************************************/
+#include "smallsh.h"
+#include <errno.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#define NUM_COUNTERS 5		// number of events counted
+#define COLLECT_TIMEOUT 1	// seconds the shell waits for a child's counters
+
+// the events counted, in the order they are printed
+enum { CYCLES, INSTRUCTIONS, REFERENCES, MISSES, SWITCHES };
+static const struct counterInfo
+{
+	uint32_t type;
+	uint64_t config;
+	const char* name;
+} counters[NUM_COUNTERS] = {
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles" },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instructions" },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES, "cache references" },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, "cache misses" },
+	{ PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, "context switches" },
+};
+
+// what a child sends the shell - the errno of each counter it could not open (0 for those
+// it could), with the file descriptors of the others in order
+struct counterMessage
+{
+	int errors[NUM_COUNTERS];
+};
+
+// the counters of a profiled job, or of a built-in command run in the shell
+struct profile
+{
+	int sockets[2];			// [0] the shell's end, [1] given to each child, or -1
+	int (*fds)[NUM_COUNTERS];	// each process's counters, -1 where not opened
+	int numProcesses;		// number of processes whose counters have been received
+	int errors[NUM_COUNTERS];	// why each counter could not be opened, 0 if it was
+};
+
+
+/* **********************************************************************************
+ ** Description: Opens one counter on the calling process. Counting in the kernel is
+		 refused where perf events are restricted, so it is tried first and
+		 then user-space only. Only system calls are used, as a cloned child
+		 shares the shell's memory
+ ** Input(s): 	 Which counter; bool - count the processes the process starts too;
+		 bool - count from when the process executes its command, rather
+		 than from now
+ ** Output(s): 	 No output
+ ** Returns: 	 The counter's file descriptor, or -1 with errno set
+ ** *******************************************************************************/
+static int openCounter(int which, int inherit, int onExec)
+{
+	struct perf_event_attr attr;
+	int fd;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = counters[which].type;
+	attr.config = counters[which].config;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	attr.disabled = onExec;
+	attr.inherit = inherit;
+	attr.enable_on_exec = onExec;
+	attr.exclude_hv = 1;
+
+	fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+	if (fd == -1 && (errno == EACCES || errno == EPERM))
+	{
+		attr.exclude_kernel = 1;
+		fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+	}
+	return fd;
+}
+
+
+/* **********************************************************************************
+ ** Description: Starts profiling a job, with a socket pair for its children to send
+		 their counters over (see profileChild)
+ ** Input(s): 	 The job
+ ** Output(s): 	 Displays an error message if the socket pair cannot be made
+ ** Returns: 	 The socket to give each of the job's children, or -1 if the job
+		 cannot be profiled
+ ** *******************************************************************************/
+int profileJob(struct job* job)
+{
+	struct profile* profile = calloc(1, sizeof(struct profile));
+
+	if (socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, profile->sockets) == -1)
+	{
+		perror("profile: unable to create socket\n");
+		fflush(stderr);		// flush output buffers after printing
+		free(profile);
+		return -1;
+	}
+
+	// a child killed before it could send its counters must not hang the shell
+	struct timeval timeout = { COLLECT_TIMEOUT, 0 };
+	setsockopt(profile->sockets[0], SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	job->profile = profile;
+	return profile->sockets[1];
+}
+
+
+// Starts profiling a built-in command run by the shell itself - the shell's own counters
+// are opened, and count from now on
+struct profile* profileShell()
+{
+	struct profile* profile = calloc(1, sizeof(struct profile));
+	int i;
+
+	profile->sockets[0] = profile->sockets[1] = -1;
+	profile->fds = malloc(sizeof(profile->fds[0]));
+	profile->numProcesses = 1;
+	for (i = 0; i < NUM_COUNTERS; i++)
+	{
+		profile->fds[0][i] = openCounter(i, 0, 0);
+		profile->errors[i] = profile->fds[0][i] == -1 ? errno : 0;
+	}
+	return profile;
+}
+
+
+/* **********************************************************************************
+ ** Description: Opens the counters of a newly started child and sends them to the
+		 shell, which waits for them (see profileCollect). Called first thing
+		 in the child, so they are always sent, and only system calls are
+		 used. A counter that cannot be opened does not stop the command
+ ** Input(s): 	 The child's end of the job's socket pair; bool - count from when
+		 the child executes its command (0 for a built-in command run in a
+		 copy of the shell, which never does)
+ ** Output(s): 	 No output
+ ** Returns: 	 Returns 0
+ ** *******************************************************************************/
+int profileChild(int socketFD, int onExec)
+{
+	struct counterMessage message;
+	int fds[NUM_COUNTERS];
+	int numFDs = 0;
+	int i;
+
+	for (i = 0; i < NUM_COUNTERS; i++)
+	{
+		int fd = openCounter(i, 1, onExec);
+		message.errors[i] = fd == -1 ? errno : 0;
+		if (fd != -1)
+		{
+			fds[numFDs++] = fd;
+		}
+	}
+
+	// the file descriptors travel as SCM_RIGHTS, and the child's own copies are closed
+	union
+	{
+		struct cmsghdr header;
+		char space[CMSG_SPACE(sizeof(fds))];
+	} control;
+	struct iovec data = { &message, sizeof(message) };
+	struct msghdr header = {0};
+	header.msg_iov = &data;
+	header.msg_iovlen = 1;
+	if (numFDs > 0)
+	{
+		header.msg_control = control.space;
+		header.msg_controllen = CMSG_SPACE(numFDs * sizeof(int));
+		struct cmsghdr* rights = CMSG_FIRSTHDR(&header);
+		rights->cmsg_level = SOL_SOCKET;
+		rights->cmsg_type = SCM_RIGHTS;
+		rights->cmsg_len = CMSG_LEN(numFDs * sizeof(int));
+		memcpy(CMSG_DATA(rights), fds, numFDs * sizeof(int));
+	}
+	sendmsg(socketFD, &header, MSG_DONTWAIT);
+	for (i = 0; i < numFDs; i++)
+	{
+		close(fds[i]);
+	}
+	return 0;
+}
+
+
+/* **********************************************************************************
+ ** Description: Receives the counters of the job's newest process, once it has been
+		 started. A child started with vfork semantics has already sent them;
+		 a forked one may not have yet, so the shell waits for them, keeping
+		 each process's counters with that process
+ ** Input(s): 	 The job's profile
+ ** Output(s): 	 No output
+ ** Returns: 	 No return value
+ ** *******************************************************************************/
+void profileCollect(struct profile* profile)
+{
+	struct counterMessage message;
+	int fds[NUM_COUNTERS];
+	union
+	{
+		struct cmsghdr header;
+		char space[CMSG_SPACE(sizeof(fds))];
+	} control;
+	struct iovec data = { &message, sizeof(message) };
+	struct msghdr header = {0};
+	int numFDs = 0;
+	int i;
+
+	header.msg_iov = &data;
+	header.msg_iovlen = 1;
+	header.msg_control = control.space;
+	header.msg_controllen = sizeof(control.space);
+	if (recvmsg(profile->sockets[0], &header, MSG_CMSG_CLOEXEC) != sizeof(message))
+	{
+		return;
+	}
+	struct cmsghdr* rights = CMSG_FIRSTHDR(&header);
+	if (rights != NULL && rights->cmsg_level == SOL_SOCKET && rights->cmsg_type == SCM_RIGHTS)
+	{
+		numFDs = (rights->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		memcpy(fds, CMSG_DATA(rights), numFDs * sizeof(int));
+	}
+
+	profile->fds = realloc(profile->fds, (profile->numProcesses + 1) * sizeof(profile->fds[0]));
+	int* processFDs = profile->fds[profile->numProcesses++];
+	int next = 0;
+	for (i = 0; i < NUM_COUNTERS; i++)
+	{
+		processFDs[i] = message.errors[i] == 0 && next < numFDs ? fds[next++] : -1;
+		if (message.errors[i] != 0 && profile->errors[i] == 0)
+		{
+			profile->errors[i] = message.errors[i];
+		}
+	}
+}
+
+
+/* **********************************************************************************
+ ** Description: Prints the totals of a job's counters, when it has finished. Each
+		 counter includes the processes its process started, once they have
+		 finished. A counter the kernel could only run for part of the time
+		 (when there are more events than hardware counters) is scaled up to
+		 the whole time
+ ** Input(s): 	 The profile
+ ** Output(s): 	 The counts, one to a line, with the instructions per cycle and the
+		 cache miss rate, or why the counters are not available
+ ** Returns: 	 No return value
+ ** *******************************************************************************/
+void profileReport(struct profile* profile)
+{
+	double totals[NUM_COUNTERS] = {0};
+	int counted[NUM_COUNTERS] = {0};
+	int i, j;
+
+	if (profile->numProcesses == 0)
+	{
+		return;
+	}
+	for (j = 0; j < profile->numProcesses; j++)
+	{
+		for (i = 0; i < NUM_COUNTERS; i++)
+		{
+			uint64_t values[3];		// count, time enabled, time running
+			if (profile->fds[j][i] != -1 && read(profile->fds[j][i], values, sizeof(values)) == sizeof(values))
+			{
+				totals[i] += values[2] == 0 ? 0 : (double)values[0] * values[1] / values[2];
+				counted[i] = 1;
+			}
+		}
+	}
+
+	fflush(stdout);
+	if (counted[CYCLES] + counted[INSTRUCTIONS] + counted[MISSES] + counted[SWITCHES] == 0)
+	{
+		int paranoid = -1;
+		FILE* file = fopen("/proc/sys/kernel/perf_event_paranoid", "r");
+		if (file != NULL)
+		{
+			if (fscanf(file, "%d", &paranoid) != 1) paranoid = -1;
+			fclose(file);
+		}
+		fprintf(stderr, "profile: performance counters are not available: %s (kernel.perf_event_paranoid is %d)\n",
+			strerror(profile->errors[CYCLES] != 0 ? profile->errors[CYCLES] : profile->errors[SWITCHES]), paranoid);
+		fflush(stderr);		// flush output buffers after printing
+		return;
+	}
+
+	for (i = 0; i < NUM_COUNTERS; i++)
+	{
+		// ENOENT means the event does not exist here, such as hardware events in most
+		// virtual machines
+		if (counted[i] == 0)
+		{
+			fprintf(stderr, "%s	not counted: %s\n", counters[i].name, profile->errors[i] == ENOENT ?
+				"not supported by this CPU" : strerror(profile->errors[i]));
+			continue;
+		}
+		fprintf(stderr, "%s	%.0f", counters[i].name, totals[i]);
+		if (i == INSTRUCTIONS && counted[CYCLES] == 1 && totals[CYCLES] > 0)
+		{
+			fprintf(stderr, " (%.2f per cycle)", totals[INSTRUCTIONS] / totals[CYCLES]);
+		}
+		else if (i == MISSES && counted[REFERENCES] == 1 && totals[REFERENCES] > 0)
+		{
+			fprintf(stderr, " (%.2f%% of references)", 100 * totals[MISSES] / totals[REFERENCES]);
+		}
+		fprintf(stderr, "\n");
+	}
+	fflush(stderr);		// flush output buffers after printing
+}
+
+
+// Closes a profile's counters and sockets and frees it. A job's counters are closed when
+// it is removed from the table (see jobRemove)
+void profileClose(struct profile* profile)
+{
+	int i, j;
+
+	for (j = 0; j < profile->numProcesses; j++)
+	{
+		for (i = 0; i < NUM_COUNTERS; i++)
+		{
+			if (profile->fds[j][i] != -1) close(profile->fds[j][i]);
+		}
+	}
+	if (profile->sockets[0] != -1) close(profile->sockets[0]);
+	if (profile->sockets[1] != -1) close(profile->sockets[1]);
+	free(profile->fds);
+	free(profile);
+}
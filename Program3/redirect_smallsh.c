@@ -0,0 +1,125 @@
+/* **********************************************************************************
+ ** Program Name:   Program 3 - smallsh (redirect_smallsh.c)
+ ** Author:         Susan Hibbert
+ ** Date:           20th May 2020
+ ** Description:    Redirection engine for the smallsh program. The parser turns each
+		    redirection (< > >> n>&m n>&- &> &>> <<<) into an operation on one
+		    file descriptor, and the operations are applied in the order they
+		    were entered - in a newly started child, or in the shell itself for
+		    a built-in command, in which case the shell's own file descriptors
+		    are copied first and put back afterwards. Only system calls are
+		    used, as a cloned child shares the shell's memory
+ ** *******************************************************************************/
+#include "smallsh.h"
+#include <errno.h>
+#include <sys/mman.h>
+
+
+// Opens the source of a redirection - a file, or for a here-string, a memory file holding
+// the string and a newline. Returns the new file descriptor, or -1
+static int openSource(struct redirect* redirect)
+{
+	if (redirect->type == REDIRECT_FILE)
+	{
+		// output files are created if they don't exist
+		return open(redirect->path, redirect->flags | O_CLOEXEC, 0644);
+	}
+
+	int fd = memfd_create("here-string", MFD_CLOEXEC);
+	if (fd == -1)
+	{
+		return -1;
+	}
+	size_t length = strlen(redirect->path);
+	if (write(fd, redirect->path, length) != (ssize_t)length || write(fd, "\n", 1) != 1 ||
+	    lseek(fd, 0, SEEK_SET) == -1)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+
+/* **********************************************************************************
+ ** Description: Applies a command's redirections in order. Each one opens a file
+		 (or here-string) onto a file descriptor, copies one file descriptor
+		 onto another, or closes one. If saved is given, each file descriptor
+		 is copied into it before it is first changed, so that
+		 restoreRedirects can put it back
+ ** Input(s): 	 The first redirection, and the copies of the file descriptors
+		 (MAX_REDIRECT_FD + 1 of them, each -1 to begin with), or NULL
+ ** Output(s): 	 Error messages are displayed if a redirection fails
+ ** Returns: 	 Returns 0, or -1 if a redirection failed
+ ** *******************************************************************************/
+int applyRedirects(struct redirect* redirect, int* saved)
+{
+	for (; redirect != NULL; redirect = redirect->next)
+	{
+		int source = -1;
+		if (redirect->type == REDIRECT_FILE || redirect->type == REDIRECT_STRING)
+		{
+			source = openSource(redirect);
+			if (source == -1)
+			{
+				dprintf(1, "Could not open %s for %s\n", redirect->path,
+					(redirect->flags & O_ACCMODE) == O_RDONLY ? "input" : "output");
+				return -1;
+			}
+		}
+		else if (redirect->type == REDIRECT_DUP && fcntl(redirect->sourceFD, F_GETFD) == -1)
+		{
+			dprintf(2, "smallsh: %d: bad file descriptor\n", redirect->sourceFD);
+			return -1;
+		}
+
+		// keep a copy of the file descriptor the first time it is changed (-2 if it was not
+		// open)
+		if (saved != NULL && saved[redirect->fd] == -1)
+		{
+			saved[redirect->fd] = fcntl(redirect->fd, F_DUPFD_CLOEXEC, MAX_REDIRECT_FD + 1);
+			if (saved[redirect->fd] == -1) saved[redirect->fd] = -2;
+		}
+
+		int result = 0;
+		if (redirect->type == REDIRECT_CLOSE)
+		{
+			close(redirect->fd);
+		}
+		else if (redirect->type == REDIRECT_DUP)
+		{
+			result = redirect->sourceFD == redirect->fd ? 0 : dup2(redirect->sourceFD, redirect->fd);
+		}
+		else
+		{
+			result = source == redirect->fd ? 0 : dup2(source, redirect->fd);
+			if (source != redirect->fd) close(source);
+			else fcntl(source, F_SETFD, 0);
+		}
+		if (result == -1)
+		{
+			dprintf(2, "Error with input/output redirection: %s\n", strerror(errno));
+			return -1;
+		}
+	}
+	return 0;
+}
+
+
+// Puts back the file descriptors saved by applyRedirects, closing those that were not open
+void restoreRedirects(int* saved)
+{
+	int fd;
+	for (fd = 0; fd <= MAX_REDIRECT_FD; fd++)
+	{
+		if (saved[fd] >= 0)
+		{
+			dup2(saved[fd], fd);
+			close(saved[fd]);
+		}
+		else if (saved[fd] == -2)
+		{
+			close(fd);
+		}
+	}
+}
@@ -0,0 +1,282 @@
+/* **********************************************************************************
+ ** Program Name:   Program 3 - smallsh (smallsh.h)
+ ** Author:         Susan Hibbert
+ ** Date:           20th May 2020
+ ** Description:    Header file for the smallsh program. Holds the command tree built
+		    by the parser for each line entered, and the functions shared
+		    between the smallsh source files
+ ** *******************************************************************************/
+#ifndef SMALLSH_H
+#define SMALLSH_H
+
+#define _GNU_SOURCE		// for pipe2 and clone
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <termios.h>
+
+#define ARENA_SIZE 65536	// bytes in the parser's first arena chunk
+
+// COMMAND TREE
+// Each line entered is parsed into a pipeline: one or more commands separated by '|',
+// optionally followed by '&'. Each command has its arguments and a list of redirections.
+// Everything in the tree lives in the arena, and is thrown away when the next line is
+// read.
+
+// kinds of redirection
+#define REDIRECT_FILE 0		// open a file onto fd (< > >> &>)
+#define REDIRECT_DUP 1		// copy sourceFD onto fd (n>&m n<&m)
+#define REDIRECT_CLOSE 2	// close fd (n>&- n<&-)
+#define REDIRECT_STRING 3	// a here-string on fd (<<< word)
+
+#define MAX_REDIRECT_FD 9	// highest file descriptor a redirection can change
+
+// a redirection of one of a command's file descriptors
+struct redirect
+{
+	int fd;				// file descriptor being redirected
+	int type;			// kind of redirection
+	int flags;			// flags to open the file with (REDIRECT_FILE)
+	int sourceFD;			// file descriptor to copy (REDIRECT_DUP)
+	char* path;			// file name, or the text of a here-string
+	struct redirect* next;		// next redirection, in the order they were entered
+};
+
+// a process substitution, <(pipeline) or >(pipeline). The pipeline is started just before
+// its command, joined to it by a pipe which the command opens as /dev/fd/N
+struct substitution
+{
+	int output;			// bool - >(pipeline): the command writes to the pipeline
+	struct pipeline* pipeline;	// the pipeline
+	char* text;			// the pipeline's command line, for the job table
+	int fd;				// the shell's end of the pipe while the command starts
+	char path[24];			// /dev/fd/N, given to the command in place of the word
+	struct substitution* next;	// next substitution of the same command
+};
+
+// a single command
+struct command
+{
+	char** argv;			// arguments, terminated by NULL
+	int argc;			// number of arguments
+	struct redirect* redirects;	// redirections, NULL if there are none
+	struct command* next;		// next command in the pipeline
+	struct substitution* substitutions;	// process substitutions, NULL if there are none
+};
+
+// a pipeline of commands joined by '|'
+struct pipeline
+{
+	struct command* first;		// first command, NULL for a blank line or comment
+	int numCommands;		// number of commands
+	int background;			// bool - run in the background (line ended with '&')
+	int timed;			// bool - report the resources used (line began with time)
+	int profiled;			// bool - count hardware events (line began with profile)
+};
+
+// a block of the parser's memory
+struct arenaChunk
+{
+	struct arenaChunk* next;	// next chunk, which is empty while this one is in use
+	size_t size;			// bytes in the chunk
+	size_t used;			// bytes handed out so far
+	char data[];
+};
+
+// memory for parsing a line, handed out from a list of chunks and reset for each line
+struct arena
+{
+	struct arenaChunk* first;	// first chunk
+	struct arenaChunk* current;	// chunk being handed out
+	struct globListing* listings;	// directories read by filename expansion on this line
+};
+
+// values of the shell's special parameters, substituted when a line is parsed
+struct specials
+{
+	char pid[24];			// $$ - the shell's process ID, written out once at startup
+	int pidLength;
+	int exitMethod;			// $? - exit method of the last foreground command
+	pid_t lastBackground;		// $! - process ID of the last background job, 0 if none
+};
+
+// where command lines are read from
+struct input
+{
+	int interactive;		// bool - read from the user at the prompt
+	const char* data;		// the script or -c string, or what has been read from stdin
+	size_t length;			// length of the script
+	size_t pos;			// start of the next line in the script
+	char* buffer;			// holds what has been read from stdin, when interactive
+	size_t bufferSize;		// size of the buffer
+	int atEnd;			// bool - stdin has reached end of file
+	char* line;			// the line last read
+	size_t lineSize;		// size of the buffer holding the line
+};
+
+// details of a command to be started by spawnStage
+struct launch
+{
+	struct command* command;	// the command
+	const char* path;		// program to execute, NULL if it was not found
+	int inFD;			// read end of the pipe from the previous command, or -1
+	int outFD;			// write end of the pipe to the next command, or -1
+	int runBackground;		// bool - the pipeline runs in the background
+	pid_t pgid;			// process group to join, 0 to start a new one
+	int terminalFD;			// terminal to give the process group, or -1
+	int cgroupFD;			// cgroup.procs of the job's cgroup to join, or -1
+	int profileFD;			// socket to send the child's event counters over, or -1
+	int builtin;			// bool - the child runs a built-in command, in a copy of the shell
+	sigset_t* mask;			// signal mask to give the child
+	int childExitMethod;		// exit method of the last foreground process, for status
+	int staleHash;			// bool - set by the child if the hashed path had gone
+};
+
+// what a job cost, from the resource usage of each of its processes as they are reaped
+struct usage
+{
+	struct rusage rusage;		// CPU time, page faults and context switches added up, and
+					// the largest maximum resident set size
+	double wall;			// seconds from the job starting to its last process finishing
+};
+
+// a pipeline the shell has started. All of its processes are in one process group, whose
+// ID is the pid of its first process
+struct job
+{
+	int id;				// job ID, used as %n by the job control commands
+	pid_t pgid;			// process group of the job
+	pid_t lastPid;			// pid of the last command, whose status is reported
+	int remaining;			// number of the job's processes not yet finished
+	int stopped;			// number of the job's processes that are stopped
+	int exitMethod;			// how the last command exited
+	int background;			// bool - the job runs in the background
+	int quiet;			// bool - removed without a message when it finishes (a
+					// process substitution)
+	char* text;			// the command line, for the jobs command
+	struct process* processes;	// the job's processes that have not finished
+	struct timespec started;	// when the job was started
+	struct usage usage;		// resources used by the job's finished processes
+	struct termios modes;		// terminal modes when the job was stopped
+	int savedModes;			// bool - modes holds the job's terminal modes
+	char* cgroup;			// the job's cgroup directory, or NULL (see limits_smallsh.c)
+	struct profile* profile;	// the job's event counters, or NULL if it is not profiled
+	struct job* next;		// next job, in order of job ID
+};
+
+// exit method of a process that exited with the given exit value
+#define EXIT_METHOD(value) ((value) << 8)
+
+// a built-in command. It returns its exit value, and sets the exit method reported by
+// status if the command changes it
+typedef int (*builtinFunction)(struct command* command, int* childExitMethod);
+
+// builtins_smallsh.c
+int exitValue(int exitMethod);
+void printUsage(FILE* stream, struct usage* usage);
+builtinFunction findBuiltin(const char* name);
+int builtinInShell(const char* name);
+int runBuiltin(struct command* command, int* childExitMethod);
+void execBuiltin(struct command* command, int childExitMethod);
+
+// main_smallsh.c
+struct job* startJob(struct pipeline* pipeline, const char* text, int inFD, int outFD, int runBackground,
+		     int takeTerminal, int childExitMethod);
+
+// events_smallsh.c
+extern int foregroundMode;
+extern sigset_t childMask;
+void eventsInit();
+void eventsPoll();
+int eventsWait(int forInput);
+
+// jobs_smallsh.c
+extern pid_t foregroundPgid;
+extern int terminalFD;
+extern pid_t lastBackgroundPid;
+extern struct usage lastUsage;
+struct job* jobCreate(const char* text, int background);
+void jobControlInit();
+void jobAddProcess(struct job* job, pid_t pid);
+void continueJob(struct job* job);
+void jobRemove(struct job* job);
+void waitJob(struct job* job);
+int reapChildren();
+int waitChild();
+void notifyJobs();
+struct job* findJob(const char* name, const char* spec);
+struct job* jobsFirst();
+void jobsShutdown();
+int jobsBuiltin(struct command* command, int* childExitMethod);
+int fgBuiltin(struct command* command, int* childExitMethod);
+int bgBuiltin(struct command* command, int* childExitMethod);
+int waitBuiltin(struct command* command, int* childExitMethod);
+int disownBuiltin(struct command* command, int* childExitMethod);
+
+// launch_smallsh.c
+char* findCommand(const char* name, char* path);
+pid_t spawnStage(struct launch* launch);
+int hashBuiltin(struct command* command, int* childExitMethod);
+
+// parallel_smallsh.c
+int parallelBuiltin(struct command* command, int* childExitMethod);
+
+// procsub_smallsh.c
+int startSubstitutions(struct command* command, int childExitMethod);
+void closeSubstitutions(struct command* command);
+int coprocBuiltin(struct command* command, int* childExitMethod);
+
+// profile_smallsh.c
+int profileJob(struct job* job);
+struct profile* profileShell();
+int profileChild(int socketFD, int onExec);
+void profileCollect(struct profile* profile);
+void profileReport(struct profile* profile);
+void profileClose(struct profile* profile);
+
+// limits_smallsh.c
+int applyLimits(int cgroupFD);
+int ulimitBuiltin(struct command* command, int* childExitMethod);
+int cgroupCreateJob(struct job* job);
+void cgroupRemoveJob(struct job* job);
+void cgroupShutdown();
+int cgroupBuiltin(struct command* command, int* childExitMethod);
+
+// redirect_smallsh.c
+int applyRedirects(struct redirect* redirect, int* saved);
+void restoreRedirects(int* saved);
+
+// history_smallsh.c
+void historyInit();
+char* historyExpand(const char* line);
+int historyBuiltin(struct command* command, int* childExitMethod);
+
+// input_smallsh.c
+void inputFromStdin(struct input* input);
+void inputFromString(struct input* input, const char* commands);
+int inputFromFile(struct input* input, const char* fileName);
+char* inputReadLine(struct input* input, int* lineLength);
+
+// parse_smallsh.c
+void arenaInit(struct arena* arena, size_t size);
+void arenaReset(struct arena* arena);
+void* arenaReserve(struct arena* arena, size_t bytes);
+void arenaCommit(struct arena* arena, void* start, size_t bytes);
+void* arenaAlloc(struct arena* arena, size_t bytes);
+struct pipeline* parseLine(struct arena* arena, const char* line, const struct specials* specials);
+
+// glob_smallsh.c
+int globHasPattern(const char* word);
+int globExpand(struct arena* arena, const char* word, char*** matches);
+
+#endif
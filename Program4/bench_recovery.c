@@ -0,0 +1,199 @@
+/* **********************************************************************************
+ ** Program Name:   Program 4 - Dead Drop (bench_recovery.c)
+ ** Author:         Susan Hibbert
+ ** Date:           3rd June 2020
+ ** Description:    Benchmark for the otp_d startup phase. It fills a directory with
+		    stored messages spread across many users (1,000,000 messages
+		    across 10,000 users by default), then starts otp_d in that
+		    directory and measures the time until otp_d accepts its first
+		    connection, once for each number of recovery threads given.
+		    otp_d must already be compiled in the current directory.
+
+		    USAGE: bench_recovery port [users] [messages per user] [threads...]
+ ** *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define BENCH_DIR "bench_drops"
+
+// Returns the time in seconds from a monotonic clock
+double now()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+
+/* **********************************************************************************
+ ** Description: Creates the stored messages, unless a previous run already created
+		 the same number of them. Each message is a 64 character encrypted
+		 message followed by a newline, as otp_d would have stored it
+ ** Input(s): 	 Number of users and number of messages per user
+ ** Output(s): 	 Displays progress and the time taken
+ ** Returns:	 No return value
+ ** *******************************************************************************/
+void createDrops(int users, int perUser)
+{
+	char marker[64];
+	char path[128];
+	char msg[65];
+	int i, j;
+
+	// a marker file records how many messages were created last time
+	sprintf(marker, "%s/.bench_%d_%d", BENCH_DIR, users, perUser);
+	if (access(marker, F_OK) == 0)
+	{
+		printf("Using existing %d messages across %d users in %s\n", users * perUser, users, BENCH_DIR);
+		return;
+	}
+
+	printf("Creating %d messages across %d users in %s...\n", users * perUser, users, BENCH_DIR);
+	fflush(stdout);
+	double start = now();
+
+	mkdir(BENCH_DIR, 0755);
+	for (i = 0; i < 64; i++)
+	{
+		msg[i] = 'A' + rand() % 26;
+	}
+	msg[64] = '\n';
+
+	for (i = 0; i < users; i++)
+	{
+		sprintf(path, "%s/user%d", BENCH_DIR, i);
+		mkdir(path, 0755);
+		int dirFD = open(path, O_RDONLY | O_DIRECTORY);
+		if (dirFD < 0)
+		{
+			perror("Error creating user directory");
+			exit(1);
+		}
+		close(openat(dirFD, ".otp_d", O_WRONLY | O_CREAT, 0600));	// otp_d's USER_MARKER
+
+		for (j = 0; j < perUser; j++)
+		{
+			char name[32];
+			sprintf(name, "cipherText%d", j);
+			int fd = openat(dirFD, name, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+			if (fd < 0)
+			{
+				perror("Error creating message");
+				exit(1);
+			}
+			write(fd, msg, sizeof(msg));
+			close(fd);
+		}
+		close(dirFD);
+	}
+
+	close(open(marker, O_WRONLY | O_CREAT, 0600));
+	printf("Created in %.1f seconds\n", now() - start);
+}
+
+
+/* **********************************************************************************
+ ** Description: Starts otp_d in the benchmark directory and waits until it accepts a
+		 connection, then stops it again
+ ** Input(s): 	 Port number and number of recovery threads
+ ** Output(s): 	 No output (otp_d's own recovery summary appears on stderr)
+ ** Returns:	 Time in seconds from starting otp_d until it was ready
+ ** *******************************************************************************/
+double timeToReady(int port, int threads)
+{
+	char portArg[16];
+	char threadsArg[16];
+	sprintf(portArg, "%d", port);
+	sprintf(threadsArg, "%d", threads);
+
+	struct sockaddr_in serverAddress;
+	memset(&serverAddress, '\0', sizeof(serverAddress));
+	serverAddress.sin_family = AF_INET;
+	serverAddress.sin_port = htons(port);
+	serverAddress.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+	double start = now();
+	pid_t spawnPid = fork();
+	if (spawnPid == -1)
+	{
+		perror("Error spawning otp_d");
+		exit(1);
+	}
+	else if (spawnPid == 0)
+	{
+		// otp_d's stdout would only show paths of posted messages
+		int devNull = open("/dev/null", O_WRONLY);
+		dup2(devNull, 1);
+		if (chdir(BENCH_DIR) == 0)
+		{
+			execl("../otp_d", "otp_d", "-r", threadsArg, portArg, NULL);
+		}
+		perror("Error running otp_d");
+		exit(1);
+	}
+
+	// keep trying to connect until otp_d is listening
+	double ready;
+	while (1)
+	{
+		int socketFD = socket(AF_INET, SOCK_STREAM, 0);
+		if (connect(socketFD, (struct sockaddr*)&serverAddress, sizeof(serverAddress)) == 0)
+		{
+			ready = now() - start;
+			close(socketFD);
+			break;
+		}
+		close(socketFD);
+
+		if (waitpid(spawnPid, NULL, WNOHANG) == spawnPid)
+		{
+			fprintf(stderr, "otp_d exited before it was ready\n");
+			exit(1);
+		}
+		usleep(1000);
+	}
+
+	// stop otp_d (and the child serving the benchmark's connection)
+	kill(spawnPid, SIGTERM);
+	waitpid(spawnPid, NULL, 0);
+	return ready;
+}
+
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2) { fprintf(stderr, "USAGE: %s port [users] [messages per user] [threads...]\n", argv[0]); exit(1); }
+
+	int port = atoi(argv[1]);
+	int users = argc > 2 ? atoi(argv[2]) : 10000;
+	int perUser = argc > 3 ? atoi(argv[3]) : 100;
+
+	createDrops(users, perUser);
+
+	// by default compare a single recovery thread with one per CPU
+	int defaultThreads[2] = { 1, (int)sysconf(_SC_NPROCESSORS_ONLN) };
+	int numRuns = argc > 4 ? argc - 4 : (defaultThreads[1] > 1 ? 2 : 1);
+	int i;
+
+	for (i = 0; i < numRuns; i++)
+	{
+		int threads = argc > 4 ? atoi(argv[4 + i]) : defaultThreads[i];
+		double ready = timeToReady(port, threads);
+		printf("threads %d: time to ready %.3f seconds (%.0f messages/second)\n", threads, ready, users * (double)perUser / ready);
+		fflush(stdout);
+	}
+
+	return 0;
+}
@@ -1,317 +1,2438 @@
-/* ********************************************************************************** 
- ** Program Name:   Program 4 - Dead Drop (otp_d.c)
- ** Author:         Susan Hibbert
- ** Date:           3rd June 2020  			      
- ** Description:    This program acts as the server. It runs in the background as a
-		    daemon. It responds to requests from otp appropriately, depending
-		    on whether it is connecting in post or get mode (details described
-		    below).
- ** *******************************************************************************/
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <unistd.h>
-#include <sys/types.h> 
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <time.h>
-#include <dirent.h>
-#include <fcntl.h>
-
-#define MAX_SIZE 100000
-
-void error(const char *msg) { perror(msg); exit(1); } // Error function used for reporting issues
-
-
-/* ********************************************************************************** 
- ** Description: This function is called after a new client connection is made. It
-		 represents a child process of otp_d. 
-		 It first checks if otp is connecting in post or get mode. If otp has
-		 connected in post mode, then this child receives a user name and
-		 encrypted message via the communication socket. The otp_d child will
-		 then write the encrypted message to a file and print the path to the
-		 file.
-		 If otp has connected in get mode, then the child process of otp_d will
-		 retrieve from otp a user name only. The child will then retrieve the
-		 contents of the oldest file for this user and send them to otp, then
-		 delete the ciphertext file.
- ** Input(s): 	 File descriptor number representing new client connection
- ** Output(s): 	 Displays error messages if there is a problem reading from the client
-		 socket. Depending on whether otp has connected in post or get mode,
-		 error messages may be displayed if an error occurs while the child of
-		 otp_d carries out any of its post or get mode tasks, as detailed
-		 above
- ** Returns:	 No return value 
- ** *******************************************************************************/
-
-void childCon(int newConnFD)
-{
-	// Initially the child process sleeps for 2 seconds
-	sleep(2);	
-
-	// Read the client's message from the socket
-	char buffer[MAX_SIZE];
-	int charsRead;
-	memset(buffer, '\0', MAX_SIZE);
-	charsRead = recv(newConnFD, buffer, (MAX_SIZE - 1), 0);
-	if (charsRead < 0) error("ERROR reading from socket");
-
-	// Retrieve mode, user and encrypted message sent by the client and save 
-	// into local variables
-	char mode[16];
-	char user[32];
-	char encryptedMsg[MAX_SIZE];
-	memset(encryptedMsg, '\0', MAX_SIZE);
-	char* token;
-
-	token = strtok(buffer, "-");
-	int field = 0;
-
-	while (token != NULL)
-	{
-		if (field == 0)
-		{
-			strcpy(user, token);
-		}
-		else if (field == 1)
-		{
-			strcpy(mode, token);
-		}
-		else if (field == 2)
-		{
-			strcpy(encryptedMsg, token);
-		}
-		field++;
-		token = strtok(NULL, "-");		
-	}
-
-	// *******************************************************************************************
-	// POST MODE
-	if (strcmp(mode, "post") == 0)
-	{
-		// create a copy of the encrypted message with a newline char at the end, so the encrypted
-		// text file ends with a newline character as per the specifications
-		int msgLength = strlen(encryptedMsg);
-		char* encryptedMsg1 = malloc(msgLength + 2);
-		strcpy(encryptedMsg1, encryptedMsg);
-		strcat(encryptedMsg1, "\n");
-	
-		// create and open a directory for the user
-		mkdir(user, 0755);
-		DIR* userDir = opendir(user);
-
-		// declare file name to store encrypted message
-		char cipherText[64];
-		char* fileName = "cipherText";
-
-		// get the process id of the child and append to the end of the file name
-		// in order to generate unique cipher text file names for each user
-		int pid = getpid();
-		sprintf(cipherText, "%s%d", fileName, pid);
-
-		// create a filepath variable and store the path to the user's directory
-		char* filepath = malloc(128*sizeof(char));
-		sprintf(filepath, "./%s/%s", user, cipherText);
-		int filedescriptor = open(filepath, O_RDWR | O_CREAT | O_TRUNC, 0600);
-	
-		// write the encrypted message to a file in the user's directory
-		write(filedescriptor, encryptedMsg1, strlen(encryptedMsg1)*sizeof(char));		
-
-		// print the path to the encrypted file	
-		printf("%s\n", filepath);
-		fflush(stdout);
-			
-		// reset the file pointer back to the beginning of the file
-		lseek(filedescriptor, 0, SEEK_SET);
-
-		// close the user directory
-		closedir(userDir);
-	}	
-	// *******************************************************************************************
-	// GET MODE
-	else if (strcmp(mode, "get") == 0)
-	{
-		// find and retrieve the encrypted file contents of the oldest file for the specified user
-	
-		time_t oldestTime = time(0);				// get current time to initialize oldestTime variable
-		DIR* userDir = opendir(user);				// open user's directory
-		struct dirent* userFile;				// holds information about a file in user's directory
-		struct stat fileStats;					// hold stats about userFile
-		char targetDirPrefix[64] = "cipherText";		// prefix of each encrypted text file
-		char* oldestFile = malloc(sizeof(char)*MAX_SIZE);	// holds the name of the oldest file
-		memset(oldestFile, '\0', MAX_SIZE);
-		char fullpath[MAX_SIZE];				// holds the full path to the oldest file
-		memset(fullpath, '\0', MAX_SIZE);
-
-		// if a directory for that user does not exit
-		if (userDir == NULL)
-		{
-			fprintf(stderr, "SERVER: User has no encrypted messages\n");
-		}
-		// if user's directory can be opened
-		else
-		{
-			// check each file in the directory
-			while((userFile = readdir(userDir)) != NULL)
-			{
-				// if the file name has the desired prefix
-				if (strstr(userFile->d_name, targetDirPrefix) != NULL)
-				{
-					// store full path to file in user's directory
-					sprintf(fullpath, "./%s/%s", user, userFile->d_name);
-
-					// get stats about the file and store in fileStats struct
-					stat(fullpath, &fileStats);
-		
-					// if the timestamp on this file is the oldest so far, save
-					// its name and timestamp
-					if ((int)fileStats.st_mtime < oldestTime)
-					{
-						oldestTime = fileStats.st_mtime;			
-						strcpy(oldestFile, fullpath);
-					}
-				}
-			}
-	
-			// close user directory
-			closedir(userDir);
-			
-			// declare a string to hold the encrypted message to be sent to the client
-			char fileToClient[MAX_SIZE];
-			memset(fileToClient, '\0', MAX_SIZE);
-
-			// if user has no encrypted messages, send 'none' to the client who
-			// will then display an error message
-			if (strlen(oldestFile) == 0)
-			{
-				sprintf(fileToClient, "%s", "none");
-			}
-			// if the user does have an encrypted message stored
-			else	
-			{
-				// store the contents of the oldest file in a string and send back to client
-				FILE *filePtr;		// file stream pointer for encrypted file
-
-				// open the oldest file for reading
-				filePtr = fopen(oldestFile, "r");
-	
-				// holds a line of the file as it is read in
-				char line[MAX_SIZE];
-				memset(line, '\0', MAX_SIZE);
-
-				// if error opening the file
-				if (filePtr == NULL)
-				{
-					fprintf(stderr, "SERVER: Error opening user file\n");
-					exit(1);
-				}	
-				// read the file into the string until reach end of file
-				while(fgets(line, sizeof(line), filePtr) != NULL)
-				{
-					sprintf(fileToClient, "%s%s", fileToClient, line);
-				}
-				// remove the trailing '\n' that fgets adds
-				fileToClient[strcspn(fileToClient, "\n")] = '\0';
-	
-				// close the file pointer
-				fclose(filePtr);
-	
-				// delete the encrypted file
-				remove(oldestFile);
-			}
-
-			// send encrypted file contents (or the word 'none') to client		
-			charsRead = send(newConnFD, fileToClient, strlen(fileToClient), 0);
-			
-			if (charsRead < 0) perror("ERROR writing to socket\n");					
-		}
-	}		
-
-	// close existing socket which is connected to the client	
-	close(newConnFD);
-}
-
-
-/* ********************************************************************************** 
- ** Description: Main function. Upon execution, otp_d will listen on a particular
-		 port/socket, assigned when it is first ran as a command line argument.
-		 When a connection is made, otp_d accepts the connection and generates
-		 a new socket used for the actual communication, and then forks a 
-		 child process to handle the rest of the transaction which will occur
-		 on the newly accepted socket. The original server daemon process will
-		 continue listening for new connections. It can support up to five
-		 concurrent socket connections running at the same time. 
- ** Input(s): 	 Command line argument representing a port number
- ** Output(s): 	 Displays error messages if there are any networking or connection
-		 issues or if an issue occurs when spawning a new child process
- ** Returns: 	 Return value of 0
- ** *******************************************************************************/
-
-int main(int argc, char *argv[])
-{	
-	int listenSocketFD, establishedConnectionFD, portNumber, charsRead;
-	socklen_t sizeOfClientInfo;
-	char buffer[MAX_SIZE];
-	struct sockaddr_in serverAddress, clientAddress;
-
-	// Check usage and command line arguments
-	if (argc < 2) { fprintf(stderr,"USAGE: %s port\n", argv[0]); exit(1); }
-
-	// Set up the address struct for this process (the server)
-	memset((char *)&serverAddress, '\0', sizeof(serverAddress)); 	// Clear out the address struct
-	portNumber = atoi(argv[1]); 					// Get the port number, convert to an integer from a string
-	serverAddress.sin_family = AF_INET; 				// Create a network-capable socket
-	serverAddress.sin_port = htons(portNumber); 			// Store the port number
-	serverAddress.sin_addr.s_addr = INADDR_ANY; 			// Any address is allowed for connection to this process
-
-	// Create and set up the socket
-	listenSocketFD = socket(AF_INET, SOCK_STREAM, 0); 
-	if (listenSocketFD < 0) error("ERROR opening socket");
-
-	// Enable the socket to begin listening and connect socket to port
-	if (bind(listenSocketFD, (struct sockaddr *)&serverAddress, sizeof(serverAddress)) < 0)
-		error("ERROR on binding");
-	listen(listenSocketFD, 5); 					// Flip the socket on - it can now receive up to 5 connections
-	sizeOfClientInfo = sizeof(clientAddress); 			// Get the size of the address for the client that will connect
-
-
-	// Accept a connection, blocking if one is not available until one connects
-	while(1)
-	{	
-		establishedConnectionFD = accept(listenSocketFD, (struct sockaddr *)&clientAddress, &sizeOfClientInfo); // Accept
-		if (establishedConnectionFD < 0) error("ERROR on accept");
-
-		// create a new child process
-		pid_t spawnPid = -5;
-		spawnPid = fork();
-	
-		// if an error occurred when forking a child
-		if (spawnPid == -1)
-		{
-			perror("Error spawning child process\n");
-		}
-		// if child process spawned successfully		
-		else if (spawnPid == 0)
-		{
-			// Child process closes the listening socket
-			close(listenSocketFD); 
-
-			// pass file descriptor of new connection as argument to childCon function
-			childCon(establishedConnectionFD);
-
-			// exit once child process returns and re-enter outer infinite while loop
-			exit(0);	
-	
-		}		
-		// if spawnPid is not equal to 0	
-		else
-		{
-			close(establishedConnectionFD);
-		}	
-
-	}
-
-	close(listenSocketFD);
-	return 0;
-}
+/* ********************************************************************************** 
+ ** Program Name:   Program 4 - Dead Drop (otp_d.c)
+ ** Author:         Susan Hibbert
+ ** Date:           3rd June 2020  			      
+ ** Description:    This program acts as the server. It runs in the background as a
+		    daemon. It responds to requests from otp appropriately, depending
+		    on whether it is connecting in post or get mode (details described
+		    below).
+ ** *******************************************************************************/
+
+#define _GNU_SOURCE		// for O_TMPFILE and fstatat
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h> 
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <time.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <limits.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <arpa/inet.h>
+
+#define MAX_SIZE 100000
+#define CACHE_USERS 64		// number of users that can hold messages in the hot tier at once
+#define CACHE_ENTRIES 64	// maximum number of messages held in memory for a single user
+#define INDEX_CHUNK 32		// number of file names held in each chunk of the queue index
+#define DIRENT_BATCH (1 << 20)	// bytes of directory entries read by each getdents64 call
+#define USER_MARKER ".otp_d"	// file marking a user directory as created by otp_d
+
+void error(const char *msg) { perror(msg); exit(1); } // Error function used for reporting issues
+
+
+// HOT MESSAGE TIER
+// Most messages are fetched shortly after they are posted, so when otp_d is started with
+// the -c option recent posts are kept in a shared memory region instead of being written
+// straight to disk. Each user gets a ring of messages backed by its own byte budget. A get
+// served from the ring never touches the file system. Messages that are pushed out of the
+// ring, or that stay unread for longer than the maximum age, are written to the user's
+// directory exactly as a normal post would have been. The cache lock is not held while
+// they are written, so no user waits for another user's disk syncs.
+
+struct cacheEntry
+{
+	int offset;			// start of the message in the user's byte ring
+	int length;			// length of the message (no trailing newline)
+	int pid;			// pid of the otp_d child that received the post
+	struct timespec posted;		// time the message was posted
+};
+
+struct cacheUser
+{
+	char name[32];			// user name, empty if the slot is free
+	int diskCount;			// number of this user's messages stored on disk
+	int head;			// index of the oldest entry in the entries ring
+	int count;			// number of entries in the ring
+	int dataStart;			// offset of the oldest message in the byte ring
+	int dataUsed;			// number of bytes of the byte ring in use
+	int spilling;			// number of the oldest entries being written out to disk
+	pid_t spiller;			// process writing them out
+	struct cacheEntry entries[CACHE_ENTRIES];
+};
+
+struct hotCache
+{
+	pthread_mutex_t lock;		// process-shared lock protecting the whole cache
+	int budget;			// byte budget of each user's ring
+	int maxAge;			// seconds a message may stay in memory before being written out
+	struct cacheUser users[CACHE_USERS];
+	char data[];			// CACHE_USERS byte rings of budget bytes each
+};
+
+struct hotCache* cache = NULL;		// NULL when the hot tier is disabled
+
+
+// QUEUE INDEX
+// Every message on disk is also listed in a shared index, so a get can go straight to a
+// user's oldest message instead of scanning and stat'ing everything in the user's
+// directory. Each user has a FIFO of file names held in a linked list of fixed-size
+// chunks. The index lives in memory only - it is rebuilt from the user directories every
+// time otp_d starts (see recoverDrops). Users who do not fit in the index, or whose queue
+// outgrows the chunk pool, are marked as overflowed and fall back to directory scans.
+
+struct indexUser
+{
+	char name[32];			// user name, empty if the slot is free
+	int head;			// chunk holding the oldest message, -1 if none
+	int tail;			// chunk holding the newest message, -1 if none
+	int headPos;			// position of the oldest message in the head chunk
+	int tailUsed;			// number of positions used in the tail chunk
+	int count;			// number of messages in the queue
+	int overflow;			// bool - the queue is incomplete and must not be trusted
+};
+
+struct indexChunk
+{
+	int next;				// next chunk in the queue (or free list), -1 if none
+	char names[INDEX_CHUNK][16];		// file names, less the "cipherText" prefix
+};
+
+struct dropIndex
+{
+	pthread_mutex_t lock;		// process-shared lock protecting the whole index
+	int userCapacity;		// number of user slots, a power of 2
+	int chunkCapacity;		// number of chunks in the pool
+	int freeChunk;			// head of the list of free chunks, -1 if none
+	struct indexUser* users;	// user slots, following this struct
+	struct indexChunk* chunks;	// chunk pool, following the user slots
+};
+
+struct dropIndex* dropIndex = NULL;
+
+// directory entry as returned by getdents64
+struct linuxDirent64
+{
+	unsigned long long d_ino;
+	long long d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+// a message file found during recovery
+struct recoveredDrop
+{
+	struct timespec mtime;		// modification time of the file
+	char name[32];			// name of the file
+};
+
+// a user directory scanned during recovery
+struct recoveredUser
+{
+	char name[32];			// user name
+	int count;			// number of messages found
+	int overflow;			// bool - a message file could not be indexed
+	struct recoveredDrop* drops;	// messages found, sorted oldest first once scanned
+};
+
+// work shared between the recovery threads
+struct recoveryJob
+{
+	struct recoveredUser* users;	// user directories to scan
+	int numUsers;			// number of user directories
+	int nextUser;			// next user directory to be scanned
+	long removed;			// number of unfinished posts removed
+	long restored;			// number of unfinished gets put back
+};
+
+
+
+// REQUEST SCHEDULING
+// The parent process reads the header of each new request (user name and mode) itself and
+// sorts the request into a class: interactive gets, bulk posts and admin requests. Each
+// class has its own queue, and requests are taken from the queues in weighted-fair order,
+// each by a newly forked worker, with at most -w workers running at once. Every request
+// is given a virtual finish time of 1/weight past its class's previous one, and the
+// queued request with the earliest finish time goes next. A burst of bulk posts therefore cannot hold up gets. Each user
+// (or source address, for requests without a user name) can also be given a token bucket
+// rate limit. A request over the limit is held back in its queue until its token is due.
+
+#define CLASS_INTERACTIVE 0
+#define CLASS_BULK 1
+#define CLASS_ADMIN 2
+#define NUM_CLASSES 3
+#define WAIT_BUCKETS 40		// queue wait histogram buckets, each twice as wide as the last
+#define RATE_BUCKETS 1024	// number of token buckets for rate limiting
+#define MAX_PENDING 1024	// maximum number of connections waiting to send their header
+#define HEADER_TIMEOUT 5000	// milliseconds a connection is given to send its header
+#define HEADER_SIZE 64		// bytes read by the scheduler to find the header
+
+const char* classNames[NUM_CLASSES] = { "interactive", "bulk", "admin" };
+const double classWeights[NUM_CLASSES] = { 4, 1, 8 };
+
+struct request
+{
+	int fd;				// client connection
+	int class;			// CLASS_INTERACTIVE, CLASS_BULK or CLASS_ADMIN
+	char header[HEADER_SIZE];	// start of the request, passed on to the worker
+	int headerLength;		// bytes of the request read so far
+	char key[48];			// user name, or source address if there is none
+	int local;			// bool - the connection came in over the loopback interface
+	struct timespec arrived;	// time the connection was accepted
+	struct timespec eligible;	// time the request's rate limit token is due
+	double finishTag;		// virtual finish time for weighted-fair queueing
+	struct request* next;		// next request in the same queue
+};
+
+struct classStats
+{
+	long served;			// number of requests handed to a worker
+	double totalWait;		// total queue wait in microseconds
+	double maxWait;			// longest queue wait in microseconds
+	long buckets[WAIT_BUCKETS];	// histogram of queue waits, in microseconds
+};
+
+struct rateBucket
+{
+	char key[48];			// user name or source address
+	double tokens;			// tokens available (negative if requests are waiting for tokens)
+	struct timespec updated;	// time the tokens were last topped up
+};
+
+struct
+{
+	int workers;				// maximum number of workers running at once
+	int active;				// number of workers currently busy
+	double rate;				// rate limit in requests per second per user, 0 for none
+	double burst;				// number of requests a user may make at once
+	double virtualTime;			// finish tag of the request dispatched last
+	double lastTag[NUM_CLASSES];		// finish tag of the request queued last in each class
+	struct request* head[NUM_CLASSES];	// queue of requests for each class, oldest first
+	struct request* tail[NUM_CLASSES];
+	int queued[NUM_CLASSES];		// number of requests in each queue
+	struct classStats stats[NUM_CLASSES];
+	long rateLimited;			// number of requests held back by the rate limit
+	struct rateBucket buckets[RATE_BUCKETS];
+	int signalPipe[2];			// written to by the SIGCHLD, SIGUSR1 and SIGTERM handlers
+	volatile sig_atomic_t reportWanted;	// bool - print the queue wait report
+	volatile sig_atomic_t stopWanted;	// bool - finish the requests being served and exit
+} scheduler;
+
+
+/* ********************************************************************************** 
+ ** Description: Creates the queue index in a shared anonymous mapping so that it is
+		 visible to every child forked afterwards
+ ** Input(s): 	 Number of user slots (rounded up to a power of 2) and number of
+		 chunks to allocate
+ ** Output(s): 	 Exits with an error message if the mapping cannot be created
+ ** Returns:	 No return value
+ ** *******************************************************************************/
+void indexInit(int users, int chunks)
+{
+	int userCapacity = 1024;
+	while (userCapacity < users)
+	{
+		userCapacity *= 2;
+	}
+
+	size_t size = sizeof(struct dropIndex) + (size_t)userCapacity * sizeof(struct indexUser) +
+		      (size_t)chunks * sizeof(struct indexChunk);
+
+	void* region = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (region == MAP_FAILED) error("ERROR creating queue index");
+
+	dropIndex = region;
+	dropIndex->userCapacity = userCapacity;
+	dropIndex->chunkCapacity = chunks;
+	dropIndex->users = (struct indexUser*)(dropIndex + 1);
+	dropIndex->chunks = (struct indexChunk*)(dropIndex->users + userCapacity);
+
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+	pthread_mutex_init(&dropIndex->lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	// thread every chunk onto the free list
+	int i;
+	for (i = 0; i < chunks; i++)
+	{
+		dropIndex->chunks[i].next = i + 1 < chunks ? i + 1 : -1;
+	}
+	dropIndex->freeChunk = chunks > 0 ? 0 : -1;
+}
+
+
+// Lock and unlock the queue index, recovering the lock if its owner died holding it
+void indexLock()
+{
+	if (pthread_mutex_lock(&dropIndex->lock) == EOWNERDEAD)
+	{
+		pthread_mutex_consistent(&dropIndex->lock);
+	}
+}
+
+void indexUnlock()
+{
+	pthread_mutex_unlock(&dropIndex->lock);
+}
+
+
+/* ********************************************************************************** 
+ ** Description: Finds a user's queue in the index, optionally creating it. Users are
+		 found by hashing their name into the table of user slots. Must be
+		 called with the index locked
+ ** Input(s): 	 User name; bool indicating whether to create a queue if the user does
+		 not have one (0 = no, 1 = yes)
+ ** Output(s): 	 No output
+ ** Returns:	 Pointer to the user's queue, or NULL if there is none
+ ** *******************************************************************************/
+struct indexUser* indexFindUser(const char* user, int create)
+{
+	if (strlen(user) >= sizeof(dropIndex->users[0].name))
+	{
+		return NULL;
+	}
+
+	// FNV-1a hash of the user name
+	unsigned int hash = 2166136261u;
+	const char* c;
+	for (c = user; *c != '\0'; c++)
+	{
+		hash = (hash ^ (unsigned char)*c) * 16777619u;
+	}
+
+	// linear probing - slots are never freed, so the first empty slot ends the search
+	int mask = dropIndex->userCapacity - 1;
+	int probes;
+	for (probes = 0; probes < dropIndex->userCapacity; probes++)
+	{
+		struct indexUser* slot = &dropIndex->users[(hash + probes) & mask];
+
+		if (slot->name[0] == '\0')
+		{
+			// keep the table at most 3/4 full so probe sequences stay short
+			if (create == 0 || probes > dropIndex->userCapacity * 3 / 4)
+			{
+				return NULL;
+			}
+			strcpy(slot->name, user);
+			slot->head = -1;
+			slot->tail = -1;
+			return slot;
+		}
+		if (strcmp(slot->name, user) == 0)
+		{
+			return slot;
+		}
+	}
+	return NULL;
+}
+
+
+/* ********************************************************************************** 
+ ** Description: Adds a message file to the end of a user's queue. If the index has
+		 no room for it the user's queue is marked as overflowed. Must be
+		 called with the index locked
+ ** Input(s): 	 User's queue and name of the message file
+ ** Output(s): 	 No output
+ ** Returns:	 No return value
+ ** *******************************************************************************/
+void indexPush(struct indexUser* slot, const char* fileName)
+{
+	const char* suffix = fileName + strlen("cipherText");
+
+	if (slot->overflow == 1 || strlen(suffix) >= sizeof(dropIndex->chunks[0].names[0]))
+	{
+		slot->overflow = 1;
+		return;
+	}
+
+	// start a new chunk if the tail chunk is full
+	if (slot->tail == -1 || slot->tailUsed == INDEX_CHUNK)
+	{
+		int chunk = dropIndex->freeChunk;
+		if (chunk == -1)
+		{
+			slot->overflow = 1;
+			return;
+		}
+		dropIndex->freeChunk = dropIndex->chunks[chunk].next;
+		dropIndex->chunks[chunk].next = -1;
+
+		if (slot->tail == -1)
+		{
+			slot->head = chunk;
+			slot->headPos = 0;
+		}
+		else
+		{
+			dropIndex->chunks[slot->tail].next = chunk;
+		}
+		slot->tail = chunk;
+		slot->tailUsed = 0;
+	}
+
+	strcpy(dropIndex->chunks[slot->tail].names[slot->tailUsed], suffix);
+	slot->tailUsed++;
+	slot->count++;
+}
+
+
+// Adds a newly published message file to the end of a user's queue
+void indexAppend(const char* user, const char* fileName)
+{
+	indexLock();
+	struct indexUser* slot = indexFindUser(user, 1);
+	if (slot != NULL)
+	{
+		indexPush(slot, fileName);
+	}
+	indexUnlock();
+}
+
+
+/* ********************************************************************************** 
+ ** Description: Removes the oldest message from a user's queue
+ ** Input(s): 	 User name; string to hold the name of the message file
+ ** Output(s): 	 No output
+ ** Returns:	 Returns 1 if a message was removed, 0 if the user's queue is empty, or
+		 -1 if the index cannot answer for this user and the user's directory
+		 must be scanned instead
+ ** *******************************************************************************/
+int indexPop(const char* user, char* fileName)
+{
+	int result = -1;
+
+	indexLock();
+	struct indexUser* slot = indexFindUser(user, 0);
+
+	if (slot != NULL && slot->overflow == 0)
+	{
+		result = 0;
+		if (slot->count > 0)
+		{
+			sprintf(fileName, "cipherText%s", dropIndex->chunks[slot->head].names[slot->headPos]);
+			slot->headPos++;
+			slot->count--;
+			result = 1;
+
+			// give the head chunk back once it has been used up
+			if (slot->headPos == INDEX_CHUNK || slot->count == 0)
+			{
+				int next = dropIndex->chunks[slot->head].next;
+				dropIndex->chunks[slot->head].next = dropIndex->freeChunk;
+				dropIndex->freeChunk = slot->head;
+
+				slot->head = next;
+				slot->headPos = 0;
+				if (slot->count == 0)
+				{
+					slot->head = -1;
+					slot->tail = -1;
+				}
+			}
+		}
+	}
+
+	indexUnlock();
+	return result;
+}
+
+
+// Returns the number of messages in a user's queue, or -1 if the index cannot say. A user
+// the index has not seen before has nothing on disk, so is given an empty queue
+int indexCount(const char* user)
+{
+	int count = -1;
+
+	indexLock();
+	struct indexUser* slot = indexFindUser(user, 1);
+	if (slot != NULL && slot->overflow == 0)
+	{
+		count = slot->count;
+	}
+	indexUnlock();
+
+	return count;
+}
+
+/* ********************************************************************************** 
+ ** Description: Creates a user's directory if it does not already exist. The new
+		 directory is set up under a hidden temporary name with a USER_MARKER
+		 file in it and then renamed into place, so every user directory
+		 otp_d creates carries the marker, even after a crash. Recovery only
+		 cleans up in directories that do (see recoverUser)
+ ** Input(s): 	 User name
+ ** Output(s): 	 No output
+ ** Returns:	 No return value
+ ** *******************************************************************************/
+void makeUserDir(const char* user)
+{
+	char tmpdir[64];
+	char marker[96];
+
+	if (access(user, F_OK) == 0)
+	{
+		return;
+	}
+
+	sprintf(tmpdir, ".newuser%d", getpid());
+	sprintf(marker, "%s/%s", tmpdir, USER_MARKER);
+	if (mkdir(tmpdir, 0755) < 0 && errno != EEXIST)
+	{
+		return;
+	}
+	close(open(marker, O_WRONLY | O_CREAT, 0600));
+
+	// another child may have created the directory in the meantime - if so, that one is kept
+	if (rename(tmpdir, user) < 0)
+	{
+		unlink(marker);
+		rmdir(tmpdir);
+	}
+}
+
+
+/* ********************************************************************************** 
+ ** Description: Writes a message to a new cipher text file in the user's directory,
+		 creating the directory if necessary. The message is written to an
+		 unnamed temporary file (or a hidden .post file where O_TMPFILE is not
+		 supported), flushed to disk and only then linked into the user's
+		 queue, and the directory is synced. A get can therefore never see a
+		 half-written file, and a crash never leaves one behind. The file is named after the pid of the
+		 otp_d child that received the post - linking never replaces an
+		 existing file, so if that name is still taken by an older message a
+		 numbered suffix is added. The file is then added to the user's queue
+		 in the index. If a post time is given, the file's
+		 modification time is set to it so that messages written out of the
+		 hot tier keep their place in the user's queue
+ ** Input(s): 	 User name, pid used to name the file, message and its length,
+		 time the message was posted (or NULL to use the current time) and a
+		 string to hold the path to the new file
+ ** Output(s): 	 No output
+ ** Returns:	 Returns 0 on success, -1 if the file could not be written
+ ** *******************************************************************************/
+int writeDrop(const char* user, int pid, const char* msg, int length, struct timespec* posted, char* filepath)
+{
+	char tmppath[128] = "";
+
+	// create a directory for the user if it does not already exist
+	makeUserDir(user);
+
+	sprintf(filepath, "./%s/cipherText%d", user, pid);
+	int filedescriptor = open(user, O_TMPFILE | O_WRONLY, 0600);
+	if (filedescriptor < 0)
+	{
+		sprintf(tmppath, "./%s/.post%d", user, pid);
+		filedescriptor = open(tmppath, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		if (filedescriptor < 0)
+		{
+			return -1;
+		}
+	}
+
+	// write the encrypted message followed by a newline character, as per the specifications
+	struct iovec parts[2] = { { (void*)msg, length }, { "\n", 1 } };
+	int result = writev(filedescriptor, parts, 2) == length + 1 ? 0 : -1;
+
+	// backdate the file to when the message was posted
+	if (posted != NULL)
+	{
+		struct timespec times[2] = { *posted, *posted };
+		futimens(filedescriptor, times);
+	}
+
+	// make sure the contents are on disk before the file becomes visible
+	if (result == 0)
+	{
+		result = fdatasync(filedescriptor);
+	}
+
+	// publish the file under the first free name
+	int attempt = 0;
+	while (result == 0)
+	{
+		if (attempt > 0)
+		{
+			sprintf(filepath, "./%s/cipherText%d_%d", user, pid, attempt);
+		}
+
+		if (tmppath[0] == '\0')
+		{
+			char procpath[64];
+			sprintf(procpath, "/proc/self/fd/%d", filedescriptor);
+			result = linkat(AT_FDCWD, procpath, AT_FDCWD, filepath, AT_SYMLINK_FOLLOW);
+		}
+		else
+		{
+			result = link(tmppath, filepath);
+		}
+
+		if (result < 0 && errno == EEXIST)
+		{
+			result = 0;
+			attempt++;
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	if (tmppath[0] != '\0')
+	{
+		unlink(tmppath);
+	}
+	close(filedescriptor);
+
+	// make the new name itself durable - a crash must not lose a post that was acknowledged
+	if (result == 0)
+	{
+		int dirFD = open(user, O_RDONLY | O_DIRECTORY);
+		if (dirFD < 0 || fsync(dirFD) < 0)
+		{
+			result = -1;
+		}
+		if (dirFD >= 0) close(dirFD);
+	}
+
+	// add the published file to the end of the user's queue
+	if (result == 0)
+	{
+		indexAppend(user, strrchr(filepath, '/') + 1);
+	}
+	return result;
+}
+
+
+/* ********************************************************************************** 
+ ** Description: Reads the next batch of entries from a directory straight from the
+		 kernel with getdents64, which returns many more entries per system
+		 call than readdir
+ ** Input(s): 	 Directory file descriptor and a buffer of DIRENT_BATCH bytes
+ ** Output(s): 	 No output
+ ** Returns:	 Number of bytes of entries read, 0 at the end of the directory
+ ** *******************************************************************************/
+int readDirBatch(int dirFD, char* batch)
+{
+	return syscall(SYS_getdents64, dirFD, batch, DIRENT_BATCH);
+}
+
+
+// Orders recovered messages oldest first, by modification time and then by name
+int compareDrops(const void* a, const void* b)
+{
+	const struct recoveredDrop* dropA = a;
+	const struct recoveredDrop* dropB = b;
+
+	if (dropA->mtime.tv_sec != dropB->mtime.tv_sec)
+	{
+		return dropA->mtime.tv_sec < dropB->mtime.tv_sec ? -1 : 1;
+	}
+	if (dropA->mtime.tv_nsec != dropB->mtime.tv_nsec)
+	{
+		return dropA->mtime.tv_nsec < dropB->mtime.tv_nsec ? -1 : 1;
+	}
+	return strcmp(dropA->name, dropB->name);
+}
+
+
+/* ********************************************************************************** 
+ ** Description: Scans one user directory during recovery. Hidden .post files left by a
+		 post that never finished are deleted. Hidden .get files left by a get
+		 that claimed a message but never finished are put back in the queue,
+		 so the message is not lost. Both are only done in directories that
+		 carry otp_d's USER_MARKER (see makeUserDir) - any other directory is
+		 only read. Every message file is stat'ed for its modification time
+		 and the user's messages are sorted oldest first
+ ** Input(s): 	 The user to scan, a buffer of DIRENT_BATCH bytes and the recovery job
+		 (for its counters)
+ ** Output(s): 	 Displays an error message if a claimed message cannot be put back
+ ** Returns:	 No return value
+ ** *******************************************************************************/
+void recoverUser(struct recoveredUser* user, char* batch, struct recoveryJob* job)
+{
+	int dirFD = open(user->name, O_RDONLY | O_DIRECTORY);
+	int capacity = 0;
+	int length;
+
+	if (dirFD < 0)
+	{
+		return;
+	}
+
+	// files are only deleted or renamed in directories otp_d created itself
+	int owned = faccessat(dirFD, USER_MARKER, F_OK, AT_SYMLINK_NOFOLLOW) == 0;
+
+	while ((length = readDirBatch(dirFD, batch)) > 0)
+	{
+		int pos = 0;
+		while (pos < length)
+		{
+			struct linuxDirent64* entry = (struct linuxDirent64*)(batch + pos);
+			const char* name = entry->d_name;
+			pos += entry->d_reclen;
+
+			if (owned == 1 && strncmp(name, ".post", 5) == 0)
+			{
+				if (unlinkat(dirFD, name, 0) == 0) __sync_fetch_and_add(&job->removed, 1);
+				continue;
+			}
+			else if (owned == 1 && strncmp(name, ".get.", 5) == 0)
+			{
+				// put the message back under its original name, unless a newer
+				// message has taken that name since
+				if (linkat(dirFD, name, dirFD, name + 5, 0) < 0)
+				{
+					fprintf(stderr, "SERVER: Could not restore %s/%s\n", user->name, name);
+					continue;
+				}
+				unlinkat(dirFD, name, 0);
+				__sync_fetch_and_add(&job->restored, 1);
+				name += 5;
+			}
+
+			if (strncmp(name, "cipherText", 10) != 0)
+			{
+				continue;
+			}
+			if (strlen(name) >= sizeof(user->drops[0].name))
+			{
+				user->overflow = 1;
+				continue;
+			}
+
+			// grow the user's list of messages as needed
+			if (user->count == capacity)
+			{
+				capacity = capacity == 0 ? 64 : capacity * 2;
+				user->drops = realloc(user->drops, capacity * sizeof(struct recoveredDrop));
+			}
+
+			struct stat fileStats;
+			if (fstatat(dirFD, name, &fileStats, AT_SYMLINK_NOFOLLOW) < 0)
+			{
+				continue;
+			}
+			user->drops[user->count].mtime = fileStats.st_mtim;
+			strcpy(user->drops[user->count].name, name);
+			user->count++;
+		}
+	}
+	close(dirFD);
+
+	qsort(user->drops, user->count, sizeof(struct recoveredDrop), compareDrops);
+}
+
+
+// Recovery thread - scans user directories until there are none left
+void* recoveryThread(void* arg)
+{
+	struct recoveryJob* job = arg;
+	char* batch = malloc(DIRENT_BATCH);
+	int next;
+
+	while ((next = __sync_fetch_and_add(&job->nextUser, 1)) < job->numUsers)
+	{
+		recoverUser(&job->users[next], batch, job);
+	}
+
+	free(batch);
+	return NULL;
+}
+
+
+/* ********************************************************************************** 
+ ** Description: Startup phase of otp_d. Lists every user directory, then scans them
+		 concurrently with a pool of threads (see recoverUser), cleaning up
+		 after any earlier otp_d that stopped part way through a request.
+		 The queue index is then sized for what was found and filled in with
+		 each user's messages, oldest first
+ ** Input(s): 	 Number of threads to scan with
+ ** Output(s): 	 Displays a summary of what was recovered, if anything
+ ** Returns:	 No return value
+ ** *******************************************************************************/
+void recoverDrops(int threads)
+{
+	struct timespec start, end;
+	struct recoveryJob job;
+	int capacity = 0;
+	int length;
+	int i, j;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	memset(&job, '\0', sizeof(job));
+
+	// list the user directories - user directories never start with a '.'
+	int topFD = open(".", O_RDONLY | O_DIRECTORY);
+	char* batch = malloc(DIRENT_BATCH);
+	while (topFD >= 0 && (length = readDirBatch(topFD, batch)) > 0)
+	{
+		int pos = 0;
+		while (pos < length)
+		{
+			struct linuxDirent64* entry = (struct linuxDirent64*)(batch + pos);
+			pos += entry->d_reclen;
+
+			if (entry->d_name[0] == '.' || strlen(entry->d_name) >= sizeof(job.users[0].name) ||
+			    (entry->d_type != DT_DIR && entry->d_type != DT_UNKNOWN))
+			{
+				continue;
+			}
+
+			if (job.numUsers == capacity)
+			{
+				capacity = capacity == 0 ? 1024 : capacity * 2;
+				job.users = realloc(job.users, capacity * sizeof(struct recoveredUser));
+			}
+			memset(&job.users[job.numUsers], '\0', sizeof(struct recoveredUser));
+			strcpy(job.users[job.numUsers].name, entry->d_name);
+			job.numUsers++;
+		}
+	}
+	free(batch);
+	if (topFD >= 0) close(topFD);
+
+	// scan the user directories concurrently
+	if (threads < 1) threads = 1;
+	if (threads > job.numUsers) threads = job.numUsers > 0 ? job.numUsers : 1;
+	pthread_t* pool = malloc(threads * sizeof(pthread_t));
+	for (i = 1; i < threads; i++)
+	{
+		if (pthread_create(&pool[i], NULL, recoveryThread, &job) != 0)
+		{
+			threads = i;
+			break;
+		}
+	}
+	recoveryThread(&job);
+	for (i = 1; i < threads; i++)
+	{
+		pthread_join(pool[i], NULL);
+	}
+	free(pool);
+
+	// size the index for what was found, with room to grow, then fill it in
+	long total = 0;
+	for (i = 0; i < job.numUsers; i++)
+	{
+		total += job.users[i].count;
+	}
+	long chunks = 2 * (total / INDEX_CHUNK + job.numUsers) + 16384;
+	indexInit(job.numUsers * 2 > 65536 ? job.numUsers * 2 : 65536, chunks > INT_MAX ? INT_MAX : chunks);
+
+	for (i = 0; i < job.numUsers; i++)
+	{
+		struct recoveredUser* user = &job.users[i];
+		struct indexUser* slot = indexFindUser(user->name, 1);
+		if (slot != NULL)
+		{
+			for (j = 0; j < user->count; j++)
+			{
+				indexPush(slot, user->drops[j].name);
+			}
+			if (user->overflow == 1)
+			{
+				slot->overflow = 1;
+			}
+		}
+		free(user->drops);
+	}
+	free(job.users);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if (total > 0 || job.removed > 0 || job.restored > 0)
+	{
+		fprintf(stderr, "SERVER: Recovered %ld messages for %d users in %.3f seconds with %d threads\n", total, job.numUsers,
+			(end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9, threads);
+	}
+	if (job.removed > 0 || job.restored > 0)
+	{
+		fprintf(stderr, "SERVER: Recovery removed %ld unfinished posts and restored %ld unfinished gets\n", job.removed, job.restored);
+	}
+}
+
+
+/* ********************************************************************************** 
+ ** Description: Counts the cipher text files currently stored in a user's directory
+ ** Input(s): 	 User name
+ ** Output(s): 	 No output
+ ** Returns:	 Number of cipher text files, 0 if the user has no directory
+ ** *******************************************************************************/
+int countDrops(const char* user)
+{
+	// the queue index can normally answer without touching the disk
+	int count = indexCount(user);
+	if (count >= 0)
+	{
+		return count;
+	}
+
+	DIR* userDir = opendir(user);
+	struct dirent* userFile;
+	count = 0;
+
+	if (userDir == NULL)
+	{
+		return 0;
+	}
+	while ((userFile = readdir(userDir)) != NULL)
+	{
+		if (strncmp(userFile->d_name, "cipherText", 10) == 0)
+		{
+			count++;
+		}
+	}
+	closedir(userDir);
+	return count;
+}
+
+
+/* ********************************************************************************** 
+ ** Description: Sets up the hot message tier in a shared anonymous mapping so that it
+		 is visible to every child forked afterwards. The lock is robust, so a
+		 child that dies while holding it does not wedge the daemon
+ ** Input(s): 	 Byte budget of each user's ring and maximum age of a message in
+		 seconds
+ ** Output(s): 	 Exits with an error message if the mapping cannot be created
+ ** Returns:	 No return value
+ ** *******************************************************************************/
+void cacheInit(int budget, int maxAge)
+{
+	size_t size = sizeof(struct hotCache) + (size_t)CACHE_USERS * budget;
+
+	cache = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (cache == MAP_FAILED) error("ERROR creating message cache");
+	memset(cache, '\0', sizeof(struct hotCache));
+
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+	pthread_mutex_init(&cache->lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	cache->budget = budget;
+	cache->maxAge = maxAge;
+}
+
+
+// Lock and unlock the hot tier. If the previous owner died while holding the lock the
+// cache is still consistent enough to use, as entries are only published once complete
+void cacheLock()
+{
+	if (pthread_mutex_lock(&cache->lock) == EOWNERDEAD)
+	{
+		pthread_mutex_consistent(&cache->lock);
+	}
+}
+
+void cacheUnlock()
+{
+	pthread_mutex_unlock(&cache->lock);
+}
+
+
+/* ********************************************************************************** 
+ ** Description: Finds a user's slot in the hot tier, optionally claiming a free slot
+		 for the user. A newly claimed slot counts the messages the user
+		 already has on disk, as those are older than anything in memory.
+		 Must be called with the cache locked
+ ** Input(s): 	 User name; bool indicating whether to claim a slot if the user does
+		 not have one (0 = no, 1 = yes)
+ ** Output(s): 	 No output
+ ** Returns:	 Pointer to the user's slot, or NULL if there is none
+ ** *******************************************************************************/
+struct cacheUser* cacheFindUser(const char* user, int create)
+{
+	struct cacheUser* freeSlot = NULL;
+	int i;
+
+	for (i = 0; i < CACHE_USERS; i++)
+	{
+		if (strcmp(cache->users[i].name, user) == 0)
+		{
+			return &cache->users[i];
+		}
+		if (freeSlot == NULL && cache->users[i].name[0] == '\0')
+		{
+			freeSlot = &cache->users[i];
+		}
+	}
+
+	if (create == 0 || freeSlot == NULL || strlen(user) >= sizeof(freeSlot->name))
+	{
+		return NULL;
+	}
+
+	memset(freeSlot, '\0', sizeof(struct cacheUser));
+	strcpy(freeSlot->name, user);
+	freeSlot->diskCount = countDrops(user);
+	return freeSlot;
+}
+
+
+// Returns the start of a user's byte ring
+char* cacheData(struct cacheUser* slot)
+{
+	return cache->data + (size_t)(slot - cache->users) * cache->budget;
+}
+
+
+// Releases a user's slot once it holds nothing and the user has nothing on disk
+void cacheRelease(struct cacheUser* slot)
+{
+	if (slot->count == 0 && slot->diskCount == 0)
+	{
+		slot->name[0] = '\0';
+	}
+}
+
+
+// Copies a message out of a user's ring into the buffer given (at least budget + 1 bytes),
+// leaving it in the ring. Must be called with the cache locked
+void cacheCopy(struct cacheUser* slot, struct cacheEntry* entry, char* msg)
+{
+	char* data = cacheData(slot);
+
+	// the message may wrap around the end of the byte ring
+	int firstPart = cache->budget - entry->offset;
+	if (firstPart >= entry->length)
+	{
+		memcpy(msg, data + entry->offset, entry->length);
+	}
+	else
+	{
+		memcpy(msg, data + entry->offset, firstPart);
+		memcpy(msg + firstPart, data, entry->length - firstPart);
+	}
+	msg[entry->length] = '\0';
+}
+
+
+// Removes the oldest message from a user's ring. Must be called with the cache locked
+void cacheDrop(struct cacheUser* slot)
+{
+	struct cacheEntry* entry = &slot->entries[slot->head];
+
+	slot->dataStart = (slot->dataStart + entry->length) % cache->budget;
+	slot->dataUsed -= entry->length;
+	slot->head = (slot->head + 1) % CACHE_ENTRIES;
+	slot->count--;
+}
+
+
+/* ********************************************************************************** 
+ ** Description: Removes the oldest message from a user's ring, copying it out to the
+		 buffer given. Must be called with the cache locked
+ ** Input(s): 	 User's slot; buffer of at least budget + 1 bytes to hold the message
+ ** Output(s): 	 No output
+ ** Returns:	 Length of the message
+ ** *******************************************************************************/
+int cachePop(struct cacheUser* slot, char* msg)
+{
+	int length = slot->entries[slot->head].length;
+
+	cacheCopy(slot, &slot->entries[slot->head], msg);
+	cacheDrop(slot);
+	return length;
+}
+
+
+/* ********************************************************************************** 
+ ** Description: Writes the oldest messages in a user's ring out to the user's
+		 directory, in order. The cache lock is let go while they are written,
+		 so the disk syncs hold up no one else - the messages stay in the
+		 ring, marked as being spilled, and gets leave the user's ring alone
+		 meanwhile. Each message only leaves the ring, and is counted as on
+		 disk, once it has been written, so one that cannot be written is
+		 kept, to be tried again later. Must be called with the cache locked,
+		 and no other process spilling the user's messages (see
+		 cacheWaitSpill); returns with it locked again
+ ** Input(s): 	 User's slot and the number of messages to write out
+ ** Output(s): 	 Displays an error message if a message could not be written
+ ** Returns:	 Returns 0 if the messages were written, -1 if any are still in the
+		 ring
+ ** *******************************************************************************/
+int cacheSpill(struct cacheUser* slot, int numMessages)
+{
+	struct cacheEntry entries[CACHE_ENTRIES];
+	char user[32];
+	char filepath[128];
+	char* msg = malloc(cache->budget + 1);
+	int written = 0;
+	int i;
+
+	strcpy(user, slot->name);
+	for (i = 0; i < numMessages; i++)
+	{
+		entries[i] = slot->entries[(slot->head + i) % CACHE_ENTRIES];
+	}
+	slot->spilling = numMessages;
+	slot->spiller = getpid();
+	cacheUnlock();
+
+	// nothing else touches the messages being spilled, so they are read without the lock
+	for (i = 0; i < numMessages; i++)
+	{
+		cacheCopy(slot, &entries[i], msg);
+		if (writeDrop(user, entries[i].pid, msg, entries[i].length, &entries[i].posted, filepath) < 0)
+		{
+			fprintf(stderr, "SERVER: Error writing %s\n", filepath);
+			break;
+		}
+		written++;
+	}
+	free(msg);
+
+	cacheLock();
+	for (i = 0; i < written; i++)
+	{
+		cacheDrop(slot);
+	}
+	slot->diskCount += written;
+	slot->spilling = 0;
+	return written == numMessages ? 0 : -1;
+}
+
+
+// Waits, with the cache locked, until no other process is spilling a user's messages. A
+// process that died part way through is not waited for - its messages are still in the
+// ring and are written out again. The slot may have been given up in the meantime, so
+// callers must check it still belongs to their user
+void cacheWaitSpill(struct cacheUser* slot)
+{
+	while (slot->spilling > 0 && kill(slot->spiller, 0) == 0)
+	{
+		cacheUnlock();
+		usleep(1000);
+		cacheLock();
+	}
+	slot->spilling = 0;
+}
+
+
+/* ********************************************************************************** 
+ ** Description: Stores a posted message in the hot tier. Older messages are written
+		 out to disk to make room if the user's ring is full. If the message
+		 cannot be held in memory at all, every message the user has in
+		 memory is written out first so the caller can write the new one to
+		 disk without it jumping the queue
+ ** Input(s): 	 User name, pid of the child that received the post, message and its
+		 length
+ ** Output(s): 	 No output
+ ** Returns:	 Returns 1 if the message was stored in memory, 0 if the caller must
+		 write it to disk
+ ** *******************************************************************************/
+int cachePost(const char* user, int pid, const char* msg, int length)
+{
+	struct cacheUser* slot;
+	int stored = 0;
+
+	cacheLock();
+	while ((slot = cacheFindUser(user, 1)) != NULL)
+	{
+		// only one process writes out a user's messages at a time, so they reach the disk
+		// in order
+		if (slot->spilling > 0)
+		{
+			cacheWaitSpill(slot);
+			continue;
+		}
+
+		// the oldest messages that must go to make room for the new one - all of them if
+		// it is too big for the ring, as everything older has to reach the disk first
+		int needed = 0;
+		int used = slot->dataUsed;
+		while (needed < slot->count &&
+		       (length > cache->budget || slot->count - needed == CACHE_ENTRIES || used + length > cache->budget))
+		{
+			used -= slot->entries[(slot->head + needed) % CACHE_ENTRIES].length;
+			needed++;
+		}
+
+		// if they cannot be written, the new message is left for the caller to write to
+		// disk. Otherwise the slot is looked at afresh, as the lock was let go
+		if (needed > 0)
+		{
+			if (cacheSpill(slot, needed) < 0) break;
+			continue;
+		}
+		if (length > cache->budget)
+		{
+			break;
+		}
+
+		// copy the message in after the newest one, wrapping around the end of the ring
+		char* data = cacheData(slot);
+		int offset = (slot->dataStart + slot->dataUsed) % cache->budget;
+		int firstPart = cache->budget - offset;
+		if (firstPart >= length)
+		{
+			memcpy(data + offset, msg, length);
+		}
+		else
+		{
+			memcpy(data + offset, msg, firstPart);
+			memcpy(data, msg + firstPart, length - firstPart);
+		}
+
+		struct cacheEntry* entry = &slot->entries[(slot->head + slot->count) % CACHE_ENTRIES];
+		entry->offset = offset;
+		entry->length = length;
+		entry->pid = pid;
+		clock_gettime(CLOCK_REALTIME, &entry->posted);
+
+		slot->dataUsed += length;
+		slot->count++;
+		stored = 1;
+		break;
+	}
+
+	// a message the caller writes to disk is counted there
+	if (slot != NULL && stored == 0)
+	{
+		slot->diskCount++;
+	}
+	cacheUnlock();
+	return stored;
+}
+
+
+/* ********************************************************************************** 
+ ** Description: Serves a get from the hot tier. Messages on disk are always older than
+		 those in memory, so memory is only used once the user has nothing
+		 left on disk, and none of their messages are on the way there. A get
+		 that races a spill finds nothing until the spill is done
+ ** Input(s): 	 User name; buffer of MAX_SIZE bytes to hold the message; bool
+		 indicating that the caller found nothing on disk (0 = no, 1 = yes)
+ ** Output(s): 	 No output
+ ** Returns:	 Returns 1 if the message was served from memory, 0 otherwise
+ ** *******************************************************************************/
+int cacheGet(const char* user, char* msg, int diskEmpty)
+{
+	int served = 0;
+
+	cacheLock();
+	struct cacheUser* slot = cacheFindUser(user, 0);
+
+	if (slot != NULL)
+	{
+		if (diskEmpty == 1)
+		{
+			slot->diskCount = 0;
+		}
+		// messages being spilled are older than the rest, and about to be on disk
+		if (slot->count > 0 && slot->diskCount == 0 && slot->spilling == 0)
+		{
+			cachePop(slot, msg);
+			served = 1;
+		}
+		cacheRelease(slot);
+	}
+
+	cacheUnlock();
+	return served;
+}
+
+
+// Records that one of a user's messages has been fetched from disk
+void cacheDiskServed(const char* user)
+{
+	cacheLock();
+	struct cacheUser* slot = cacheFindUser(user, 0);
+	if (slot != NULL)
+	{
+		if (slot->diskCount > 0)
+		{
+			slot->diskCount--;
+		}
+		cacheRelease(slot);
+	}
+	cacheUnlock();
+}
+
+
+// Set by the flusher's SIGTERM handler to have it write everything out and exit
+volatile sig_atomic_t flusherStopWanted = 0;
+
+void catchFlusherSIGTERM(int sigNo)
+{
+	flusherStopWanted = 1;
+}
+
+
+/* ********************************************************************************** 
+ ** Description: Writes out every message held in memory, for every user. Must be
+		 called with the cache locked; returns with it locked again
+ ** Input(s): 	 No input
+ ** Output(s): 	 Displays an error message if a message could not be written
+ ** Returns:	 No return value
+ ** *******************************************************************************/
+void cacheDrain()
+{
+	int i;
+
+	for (i = 0; i < CACHE_USERS; i++)
+	{
+		struct cacheUser* slot = &cache->users[i];
+		char user[32];
+
+		// the slot is looked at afresh after each wait or spill, as the lock was let go.
+		// A user whose messages cannot be written is given up on, and the rest are tried
+		strcpy(user, slot->name);
+		while (slot->name[0] != '\0' && strcmp(slot->name, user) == 0 && slot->count > 0)
+		{
+			if (slot->spilling > 0)
+			{
+				cacheWaitSpill(slot);
+				continue;
+			}
+			if (cacheSpill(slot, slot->count) < 0) break;
+		}
+	}
+}
+
+
+/* ********************************************************************************** 
+ ** Description: Runs in its own child process for as long as otp_d is running. Once a
+		 second it writes out every message that has been held in memory for
+		 longer than the maximum age. When otp_d stops (or sends it SIGTERM
+		 once its workers are done), it writes out everything left in memory
+		 before exiting, so no post is lost. SIGINT from the terminal is
+		 ignored - otp_d sends SIGTERM once no worker can post any more
+ ** Input(s): 	 Pid of the otp_d parent process
+ ** Output(s): 	 No output
+ ** Returns:	 Does not return
+ ** *******************************************************************************/
+void cacheFlusher(pid_t parentPid)
+{
+	struct sigaction SIGTERM_action = {0};
+	SIGTERM_action.sa_handler = catchFlusherSIGTERM;
+	sigfillset(&SIGTERM_action.sa_mask);
+	sigaction(SIGTERM, &SIGTERM_action, NULL);
+	signal(SIGINT, SIG_IGN);
+
+	while (getppid() == parentPid && flusherStopWanted == 0)
+	{
+		sleep(1);
+
+		time_t cutoff = time(0) - cache->maxAge;
+		int i;
+
+		cacheLock();
+		for (i = 0; i < CACHE_USERS; i++)
+		{
+			struct cacheUser* slot = &cache->users[i];
+			int old = 0;
+
+			// a user whose messages are already being spilled is left for next time, unless
+			// the process spilling them died
+			if (slot->name[0] == '\0' || (slot->spilling > 0 && kill(slot->spiller, 0) == 0))
+			{
+				continue;
+			}
+			slot->spilling = 0;
+			while (old < slot->count && slot->entries[(slot->head + old) % CACHE_ENTRIES].posted.tv_sec <= cutoff)
+			{
+				old++;
+			}
+			if (old > 0)
+			{
+				cacheSpill(slot, old);
+			}
+		}
+		cacheUnlock();
+	}
+
+	cacheLock();
+	cacheDrain();
+	cacheUnlock();
+	exit(0);
+}
+
+
+
+/* ********************************************************************************** 
+ ** Description: Reads a request from the client as it arrives. A request is the user
+		 name and the mode, each followed by a '-' character. In post mode
+		 these are followed by the encrypted message and a newline character.
+		 Each block of the encrypted message is checked against the 27
+		 permitted characters as soon as it is received, so a bad message is
+		 rejected without waiting for the rest of it. A post that ends before
+		 its newline character was abandoned by the client and is rejected
+ ** Input(s): 	 File descriptor of the client connection; the start of the request
+		 if it has already been read from the socket, and its length (up to
+		 4096 bytes); strings to hold the user name (32 chars), mode (16
+		 chars) and encrypted message (MAX_SIZE chars)
+ ** Output(s): 	 Displays an error message if the request is rejected
+ ** Returns:	 Returns 0 if a complete, valid request was received, otherwise
+		 returns -1
+ ** *******************************************************************************/
+int readRequest(int newConnFD, const char* prefix, int prefixLength, char* user, char* mode, char* encryptedMsg)
+{
+	char buffer[4096];
+	int charsRead;
+	int field = 0;			// 0 = user name, 1 = mode, 2 = encrypted message
+	int fieldLength = 0;
+	int msgLength = 0;
+	int complete = 0;
+
+	user[0] = '\0';
+	mode[0] = '\0';
+	encryptedMsg[0] = '\0';
+
+	// start with whatever the scheduler has already read
+	memcpy(buffer, prefix, prefixLength);
+	charsRead = prefixLength > 0 ? prefixLength : recv(newConnFD, buffer, sizeof(buffer), 0);
+
+	while (complete == 0 && charsRead > 0)
+	{
+		int i;
+		for (i = 0; i < charsRead && complete == 0; i++)
+		{
+			char c = buffer[i];
+
+			// user name and mode, each terminated by '-'
+			if (field < 2)
+			{
+				char* dest = field == 0 ? user : mode;
+				int size = field == 0 ? 32 : 16;
+
+				if (c == '-')
+				{
+					field++;
+					fieldLength = 0;
+
+					// there is nothing more to a get request
+					if (field == 2 && strcmp(mode, "post") != 0)
+					{
+						complete = 1;
+					}
+				}
+				else if (fieldLength == size - 1)
+				{
+					fprintf(stderr, "SERVER: Request header too long\n");
+					return -1;
+				}
+				else
+				{
+					dest[fieldLength++] = c;
+					dest[fieldLength] = '\0';
+				}
+			}
+			// the encrypted message, terminated by a newline
+			else if (c == '\n')
+			{
+				complete = 1;
+			}
+			else if (c != 32 && (c < 65 || c > 90))
+			{
+				fprintf(stderr, "SERVER: Bad character in message for %s at offset %d, message rejected\n", user, msgLength);
+				return -1;
+			}
+			else if (msgLength == MAX_SIZE - 1)
+			{
+				fprintf(stderr, "SERVER: Message for %s is too long, message rejected\n", user);
+				return -1;
+			}
+			else
+			{
+				encryptedMsg[msgLength++] = c;
+			}
+		}
+
+		// read the next block
+		if (complete == 0)
+		{
+			charsRead = recv(newConnFD, buffer, sizeof(buffer), 0);
+		}
+	}
+	if (charsRead < 0) error("ERROR reading from socket");
+
+	encryptedMsg[msgLength] = '\0';
+
+	// a get request may also end when the client stops sending
+	if (complete == 0 && field == 1 && strcmp(mode, "get") == 0)
+	{
+		complete = 1;
+	}
+	if (complete == 0)
+	{
+		if (field == 2)
+		{
+			fprintf(stderr, "SERVER: Incomplete message for %s, message rejected\n", user);
+		}
+		return -1;
+	}
+	return 0;
+}
+
+
+/* ********************************************************************************** 
+ ** Description: Returns the time elapsed between two times, in microseconds
+ ** Input(s): 	 Start and end times
+ ** Output(s): 	 No output
+ ** Returns:	 Microseconds from start to end
+ ** *******************************************************************************/
+double elapsedMicros(struct timespec* start, struct timespec* end)
+{
+	return (end->tv_sec - start->tv_sec) * 1e6 + (end->tv_nsec - start->tv_nsec) / 1e3;
+}
+
+
+// Records how long a request waited in its class's queue before a worker took it
+void recordWait(int class, double waitMicros)
+{
+	struct classStats* stats = &scheduler.stats[class];
+	int bucket = 0;
+
+	while (bucket < WAIT_BUCKETS - 1 && waitMicros >= (double)(2L << bucket))
+	{
+		bucket++;
+	}
+	stats->buckets[bucket]++;
+	stats->served++;
+	stats->totalWait += waitMicros;
+	if (waitMicros > stats->maxWait)
+	{
+		stats->maxWait = waitMicros;
+	}
+}
+
+
+// Returns an upper bound on the given percentile of a class's queue wait, in microseconds
+double waitPercentile(struct classStats* stats, double percentile)
+{
+	long target = (long)(stats->served * percentile + 0.5);
+	long seen = 0;
+	int bucket;
+
+	for (bucket = 0; bucket < WAIT_BUCKETS; bucket++)
+	{
+		seen += stats->buckets[bucket];
+		if (seen >= target && seen > 0)
+		{
+			double bound = (double)(2L << bucket);
+			return bound < stats->maxWait ? bound : stats->maxWait;
+		}
+	}
+	return 0;
+}
+
+
+/* ********************************************************************************** 
+ ** Description: Writes a report of the time requests of each class have spent
+		 waiting for a worker
+ ** Input(s): 	 String to hold the report and its size
+ ** Output(s): 	 No output
+ ** Returns:	 No return value
+ ** *******************************************************************************/
+void writeStats(char* report, int size)
+{
+	int length = snprintf(report, size, "%-12s %8s %8s %12s %12s %12s %12s\n",
+			      "class", "served", "queued", "wait mean", "wait p50", "wait p99", "wait max");
+	int class;
+
+	for (class = 0; class < NUM_CLASSES && length < size; class++)
+	{
+		struct classStats* stats = &scheduler.stats[class];
+		length += snprintf(report + length, size - length, "%-12s %8ld %8d %9.3f ms %9.3f ms %9.3f ms %9.3f ms\n",
+				   classNames[class], stats->served, scheduler.queued[class],
+				   stats->served > 0 ? stats->totalWait / stats->served / 1000 : 0,
+				   waitPercentile(stats, 0.50) / 1000, waitPercentile(stats, 0.99) / 1000, stats->maxWait / 1000);
+	}
+	if (length < size)
+	{
+		snprintf(report + length, size - length, "rate limited %ld requests\n", scheduler.rateLimited);
+	}
+}
+
+
+// Returns 1 if a connection came in over the loopback interface (127.0.0.0/8), 0 otherwise
+int isLoopback(int connFD)
+{
+	struct sockaddr_in peer;
+	socklen_t size = sizeof(peer);
+
+	if (getpeername(connFD, (struct sockaddr*)&peer, &size) < 0 || peer.sin_family != AF_INET)
+	{
+		return 0;
+	}
+	return (ntohl(peer.sin_addr.s_addr) >> 24) == 127;
+}
+
+
+/* ********************************************************************************** 
+ ** Description: This function is called after a new client connection is made. It
+		 represents a child process of otp_d. 
+		 It first checks if otp is connecting in post or get mode. If otp has
+		 connected in post mode, then this child receives a user name and
+		 encrypted message via the communication socket, rejecting it as soon
+		 as a bad character arrives. The otp_d child will
+		 then write the encrypted message to a file and print the path to the
+		 file.
+		 If otp has connected in get mode, then the child process of otp_d will
+		 retrieve from otp a user name only. The child will then retrieve the
+		 contents of the oldest file for this user and send them to otp, then
+		 delete the ciphertext file.
+		 In stats mode, the child sends back the scheduler's queue wait report
+		 as it stood when this request was taken from its queue, as long as
+		 otp connected from the same machine.
+ ** Input(s): 	 File descriptor number representing new client connection; the
+		 start of the request already read by the scheduler and its length
+ ** Output(s): 	 Displays error messages if there is a problem reading from the client
+		 socket. Depending on whether otp has connected in post or get mode,
+		 error messages may be displayed if an error occurs while the child of
+		 otp_d carries out any of its post or get mode tasks, as detailed
+		 above
+ ** Returns:	 No return value 
+ ** *******************************************************************************/
+
+void childCon(int newConnFD, const char* header, int headerLength)
+{
+	// Initially the child process sleeps for 2 seconds
+	sleep(2);	
+
+	// Read the client's request from the socket, retrieving the mode, user and encrypted
+	// message sent by the client into local variables. Bad or incomplete messages are
+	// rejected here, before anything is written
+	char mode[16];
+	char user[32];
+	char encryptedMsg[MAX_SIZE];
+	int charsRead;
+
+	if (readRequest(newConnFD, header, headerLength, user, mode, encryptedMsg) < 0)
+	{
+		close(newConnFD);
+		return;
+	}
+
+	// *******************************************************************************************
+	// POST MODE
+	if (strcmp(mode, "post") == 0)
+	{
+		int msgLength = strlen(encryptedMsg);
+		int pid = getpid();
+		char filepath[128];
+
+		// keep the message in memory if the hot tier is enabled and has room for it,
+		// otherwise write the encrypted message to a file in the user's directory
+		if (cache != NULL && cachePost(user, pid, encryptedMsg, msgLength) == 1)
+		{
+			// this is where the message will be written if it is not fetched in time
+			sprintf(filepath, "./%s/cipherText%d", user, pid);
+		}
+		else if (writeDrop(user, pid, encryptedMsg, msgLength, NULL, filepath) < 0)
+		{
+			fprintf(stderr, "SERVER: Error writing %s\n", filepath);
+		}
+
+		// print the path to the encrypted file	
+		printf("%s\n", filepath);
+		fflush(stdout);
+	}	
+	// *******************************************************************************************
+	// GET MODE
+	else if (strcmp(mode, "get") == 0)
+	{
+		// find and retrieve the encrypted file contents of the oldest file for the specified user
+	
+		struct timespec oldestTime;				// get current time to initialize oldestTime variable
+		clock_gettime(CLOCK_REALTIME, &oldestTime);
+		DIR* userDir = opendir(user);				// open user's directory
+		struct dirent* userFile;				// holds information about a file in user's directory
+		struct stat fileStats;					// hold stats about userFile
+		char targetDirPrefix[64] = "cipherText";		// prefix of each encrypted text file
+		char* oldestFile = malloc(sizeof(char)*MAX_SIZE);	// holds the name of the oldest file
+		memset(oldestFile, '\0', MAX_SIZE);
+		char fullpath[MAX_SIZE];				// holds the full path to the oldest file
+		memset(fullpath, '\0', MAX_SIZE);
+		char claimedFile[MAX_SIZE];				// path the oldest file is moved to while it is sent
+		char fileToClient[MAX_SIZE];				// holds the encrypted message to be sent to the client
+		memset(fileToClient, '\0', MAX_SIZE);
+
+		// serve the message straight from memory if the user has nothing older on disk
+		if (cache != NULL && cacheGet(user, fileToClient, 0) == 1)
+		{
+			if (userDir != NULL) closedir(userDir);
+			charsRead = send(newConnFD, fileToClient, strlen(fileToClient), 0);
+			if (charsRead < 0) perror("ERROR writing to socket\n");
+			close(newConnFD);
+			return;
+		}
+
+		// if a directory for that user does not exit
+		if (userDir == NULL)
+		{
+			fprintf(stderr, "SERVER: User has no encrypted messages\n");
+		}
+		// if user's directory can be opened
+		else
+		{
+			// the oldest file is claimed by renaming it out of the user's queue before it is
+			// read, so two gets can never serve the same message
+			int claimed = 0;
+			char oldestName[64];
+
+			// the queue index normally says which file is the oldest, so the directory does
+			// not have to be scanned. A file that has disappeared since is skipped
+			int indexed;
+			while (claimed == 0 && (indexed = indexPop(user, oldestName)) == 1)
+			{
+				sprintf(oldestFile, "./%s/%s", user, oldestName);
+				sprintf(claimedFile, "./%s/.get.%s", user, oldestName);
+				if (rename(oldestFile, claimedFile) == 0)
+				{
+					claimed = 1;
+				}
+				else
+				{
+					memset(oldestFile, '\0', MAX_SIZE);
+				}
+			}
+
+			// otherwise check each file in the directory - if another get claims the oldest
+			// file first, the directory is scanned again
+			while (claimed == 0 && indexed == -1)
+			{
+				clock_gettime(CLOCK_REALTIME, &oldestTime);
+				memset(oldestFile, '\0', MAX_SIZE);
+				rewinddir(userDir);
+
+				while((userFile = readdir(userDir)) != NULL)
+				{
+					// if the file name has the desired prefix
+					if (strncmp(userFile->d_name, targetDirPrefix, strlen(targetDirPrefix)) == 0)
+					{
+						// store full path to file in user's directory
+						sprintf(fullpath, "./%s/%s", user, userFile->d_name);
+
+						// get stats about the file and store in fileStats struct
+						if (stat(fullpath, &fileStats) < 0) continue;
+			
+						// if the timestamp on this file is the oldest so far, save
+						// its name and timestamp
+						// (compared to the nanosecond, as messages written out of the
+						// hot tier are often posted within the same second)
+						if (fileStats.st_mtim.tv_sec < oldestTime.tv_sec ||
+						    (fileStats.st_mtim.tv_sec == oldestTime.tv_sec && fileStats.st_mtim.tv_nsec < oldestTime.tv_nsec))
+						{
+							oldestTime = fileStats.st_mtim;			
+							strcpy(oldestFile, fullpath);
+							sprintf(claimedFile, "./%s/.get.%s", user, userFile->d_name);
+						}
+					}
+				}
+
+				if (strlen(oldestFile) == 0)
+				{
+					break;
+				}
+				if (rename(oldestFile, claimedFile) == 0)
+				{
+					claimed = 1;
+				}
+				else if (errno != ENOENT)
+				{
+					fprintf(stderr, "SERVER: Error claiming %s\n", oldestFile);
+					memset(oldestFile, '\0', MAX_SIZE);
+					break;
+				}
+			}
+
+			// sync the claim before the message is sent, as writeDrop syncs a post, so a
+			// crash cannot undo a rename that another get has already acted on
+			if (claimed == 1)
+			{
+				fsync(dirfd(userDir));
+			}
+	
+			// close user directory
+			closedir(userDir);
+			
+			// if user has no encrypted messages, send 'none' to the client who
+			// will then display an error message
+			if (strlen(oldestFile) == 0)
+			{
+				// anything the user still has in memory is now the oldest message
+				if (cache == NULL || cacheGet(user, fileToClient, 1) == 0)
+				{
+					sprintf(fileToClient, "%s", "none");
+				}
+			}
+			// if the user does have an encrypted message stored
+			else	
+			{
+				// store the contents of the oldest file in a string and send back to client
+				FILE *filePtr;		// file stream pointer for encrypted file
+
+				// open the oldest file for reading
+				filePtr = fopen(claimedFile, "r");
+	
+				// holds a line of the file as it is read in
+				char line[MAX_SIZE];
+				memset(line, '\0', MAX_SIZE);
+
+				// if error opening the file
+				if (filePtr == NULL)
+				{
+					fprintf(stderr, "SERVER: Error opening user file\n");
+					exit(1);
+				}	
+				// read the file into the string until reach end of file
+				while(fgets(line, sizeof(line), filePtr) != NULL)
+				{
+					sprintf(fileToClient, "%s%s", fileToClient, line);
+				}
+				// remove the trailing '\n' that fgets adds
+				fileToClient[strcspn(fileToClient, "\n")] = '\0';
+	
+				// close the file pointer
+				fclose(filePtr);
+	
+				// delete the encrypted file
+				remove(claimedFile);
+				if (cache != NULL) cacheDiskServed(user);
+			}
+
+			// send encrypted file contents (or the word 'none') to client		
+			charsRead = send(newConnFD, fileToClient, strlen(fileToClient), 0);
+			
+			if (charsRead < 0) perror("ERROR writing to socket\n");					
+		}
+	}		
+
+	// *******************************************************************************************
+	// STATS MODE
+	// send the scheduler's report of how long each class of request waited for a worker
+	else if (strcmp(mode, "stats") == 0 && isLoopback(newConnFD) == 1)
+	{
+		char report[2048];
+		writeStats(report, sizeof(report));
+
+		charsRead = send(newConnFD, report, strlen(report), 0);
+		if (charsRead < 0) perror("ERROR writing to socket\n");
+	}
+
+	// close existing socket which is connected to the client	
+	close(newConnFD);
+}
+
+
+// Signal handlers for the scheduler - they only wake up the scheduler's main loop, which
+// does the real work
+void catchSIGCHLD(int sigNo)
+{
+	int savedErrno = errno;
+	write(scheduler.signalPipe[1], "c", 1);
+	errno = savedErrno;
+}
+
+void catchSIGUSR1(int sigNo)
+{
+	scheduler.reportWanted = 1;
+	catchSIGCHLD(sigNo);
+}
+
+void catchSIGTERM(int sigNo)
+{
+	scheduler.stopWanted = 1;
+	catchSIGCHLD(sigNo);
+}
+
+
+/* ********************************************************************************** 
+ ** Description: Sorts a request into its class once its header has been read. Gets
+		 are interactive, stats requests from the same machine are admin,
+		 and everything else (posts, and anything the worker will reject) is
+		 bulk. The request's rate limit key becomes its user name, if it has
+		 one
+ ** Input(s): 	 The request
+ ** Output(s): 	 No output
+ ** Returns:	 No return value
+ ** *******************************************************************************/
+void classifyRequest(struct request* req)
+{
+	char mode[16] = "";
+	char* firstDash = memchr(req->header, '-', req->headerLength);
+
+	if (firstDash != NULL)
+	{
+		int userLength = firstDash - req->header;
+		char* secondDash = memchr(firstDash + 1, '-', req->headerLength - userLength - 1);
+		int modeLength = (secondDash != NULL ? secondDash : req->header + req->headerLength) - firstDash - 1;
+
+		if (userLength > 0 && userLength < 32)
+		{
+			memcpy(req->key, req->header, userLength);
+			req->key[userLength] = '\0';
+		}
+		if (modeLength < sizeof(mode))
+		{
+			memcpy(mode, firstDash + 1, modeLength);
+			mode[modeLength] = '\0';
+		}
+	}
+
+	if (strcmp(mode, "get") == 0) req->class = CLASS_INTERACTIVE;
+	else if (strcmp(mode, "stats") == 0 && req->local == 1) req->class = CLASS_ADMIN;
+	else req->class = CLASS_BULK;
+}
+
+
+/* ********************************************************************************** 
+ ** Description: Applies the token bucket rate limit for the request's user (or source
+		 address). Each request takes one token. The bucket is allowed to go
+		 into debt, and a request taken on debt is held back until the time
+		 its token will have been earned. Admin requests are never limited
+ ** Input(s): 	 The request and the current time
+ ** Output(s): 	 No output
+ ** Returns:	 No return value
+ ** *******************************************************************************/
+void rateLimit(struct request* req, struct timespec* now)
+{
+	req->eligible = *now;
+	if (scheduler.rate <= 0 || req->class == CLASS_ADMIN)
+	{
+		return;
+	}
+
+	// FNV-1a hash of the key picks the bucket - a bucket that belonged to another key is
+	// taken over, with a full set of tokens
+	unsigned int hash = 2166136261u;
+	const char* c;
+	for (c = req->key; *c != '\0'; c++)
+	{
+		hash = (hash ^ (unsigned char)*c) * 16777619u;
+	}
+	struct rateBucket* bucket = &scheduler.buckets[hash % RATE_BUCKETS];
+	if (strcmp(bucket->key, req->key) != 0)
+	{
+		strcpy(bucket->key, req->key);
+		bucket->tokens = scheduler.burst;
+		bucket->updated = *now;
+	}
+
+	// top up the tokens earned since last time, up to the burst size
+	bucket->tokens += elapsedMicros(&bucket->updated, now) / 1e6 * scheduler.rate;
+	if (bucket->tokens > scheduler.burst)
+	{
+		bucket->tokens = scheduler.burst;
+	}
+	bucket->updated = *now;
+
+	bucket->tokens -= 1;
+	if (bucket->tokens < 0)
+	{
+		double delay = -bucket->tokens / scheduler.rate;
+		req->eligible.tv_sec += (time_t)delay;
+		req->eligible.tv_nsec += (long)((delay - (time_t)delay) * 1e9);
+		if (req->eligible.tv_nsec >= 1000000000)
+		{
+			req->eligible.tv_sec++;
+			req->eligible.tv_nsec -= 1000000000;
+		}
+		scheduler.rateLimited++;
+	}
+}
+
+
+// Adds a classified request to the end of its class's queue, giving it a virtual finish
+// time 1/weight after the later of the current virtual time and its class's last request
+void enqueueRequest(struct request* req)
+{
+	int class = req->class;
+	double start = scheduler.lastTag[class] > scheduler.virtualTime ? scheduler.lastTag[class] : scheduler.virtualTime;
+
+	req->finishTag = start + 1.0 / classWeights[class];
+	scheduler.lastTag[class] = req->finishTag;
+
+	req->next = NULL;
+	if (scheduler.tail[class] == NULL)
+	{
+		scheduler.head[class] = req;
+	}
+	else
+	{
+		scheduler.tail[class]->next = req;
+	}
+	scheduler.tail[class] = req;
+	scheduler.queued[class]++;
+}
+
+
+/* ********************************************************************************** 
+ ** Description: Picks the next request for a worker - the oldest request in each
+		 class that its rate limit allows, and of those, the one with the
+		 earliest virtual finish time. The request is removed from its queue
+ ** Input(s): 	 The current time; pointer to receive the milliseconds until a held
+		 back request becomes eligible (left alone if there is none)
+ ** Output(s): 	 No output
+ ** Returns:	 The request, or NULL if no request can go now
+ ** *******************************************************************************/
+struct request* pickRequest(struct timespec* now, int* wakeMillis)
+{
+	struct request* best = NULL;
+	struct request* bestPrev = NULL;
+	int class;
+
+	for (class = 0; class < NUM_CLASSES; class++)
+	{
+		struct request* prev = NULL;
+		struct request* req;
+
+		for (req = scheduler.head[class]; req != NULL; prev = req, req = req->next)
+		{
+			double wait = elapsedMicros(now, &req->eligible);
+			if (wait <= 0)
+			{
+				if (best == NULL || req->finishTag < best->finishTag)
+				{
+					best = req;
+					bestPrev = prev;
+				}
+				break;
+			}
+
+			// remember when the first held back request will be allowed to go
+			int millis = (int)(wait / 1000) + 1;
+			if (*wakeMillis < 0 || millis < *wakeMillis)
+			{
+				*wakeMillis = millis;
+			}
+		}
+	}
+
+	if (best != NULL)
+	{
+		class = best->class;
+		if (bestPrev == NULL)
+		{
+			scheduler.head[class] = best->next;
+		}
+		else
+		{
+			bestPrev->next = best->next;
+		}
+		if (scheduler.tail[class] == best)
+		{
+			scheduler.tail[class] = bestPrev;
+		}
+		scheduler.queued[class]--;
+		scheduler.virtualTime = best->finishTag;
+	}
+	return best;
+}
+
+
+/* ********************************************************************************** 
+ ** Description: Hands a request to a new worker - a child process of otp_d that
+		 carries out the rest of the transaction (see childCon). The child
+		 closes every other connection the scheduler holds, so that those
+		 clients see their connections close when their own worker is done
+ ** Input(s): 	 The request; the listening socket; connections still sending their
+		 headers and the number of them
+ ** Output(s): 	 Displays an error message if the child cannot be spawned
+ ** Returns:	 No return value
+ ** *******************************************************************************/
+void dispatchRequest(struct request* req, int listenSocketFD, struct request** pending, int numPending)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	recordWait(req->class, elapsedMicros(&req->arrived, &now));
+
+	// create a new child process
+	pid_t spawnPid = fork();
+
+	// if an error occurred when forking a child
+	if (spawnPid == -1)
+	{
+		perror("Error spawning child process\n");
+	}
+	// if child process spawned successfully		
+	else if (spawnPid == 0)
+	{
+		int i;
+		struct request* other;
+
+		signal(SIGCHLD, SIG_DFL);
+		signal(SIGUSR1, SIG_DFL);
+		signal(SIGTERM, SIG_DFL);
+		signal(SIGINT, SIG_DFL);
+		close(scheduler.signalPipe[0]);
+		close(scheduler.signalPipe[1]);
+		close(listenSocketFD); 
+		for (i = 0; i < numPending; i++)
+		{
+			close(pending[i]->fd);
+		}
+		for (i = 0; i < NUM_CLASSES; i++)
+		{
+			for (other = scheduler.head[i]; other != NULL; other = other->next)
+			{
+				close(other->fd);
+			}
+		}
+
+		// pass file descriptor of new connection as argument to childCon function
+		childCon(req->fd, req->header, req->headerLength);
+
+		// exit once child process returns
+		exit(0);
+	}
+	else
+	{
+		scheduler.active++;
+	}
+
+	close(req->fd);
+	free(req);
+}
+
+
+/* ********************************************************************************** 
+ ** Description: Stops otp_d once it has been sent SIGTERM or SIGINT. No new
+		 connections are taken, and requests that have not reached a worker
+		 are dropped (their clients see the connection close). Workers are
+		 left to finish, then the cache flusher is told to write out every
+		 message still held in memory, and waited for
+ ** Input(s): 	 The listening socket; connections still sending their headers and
+		 the number of them; the pid of the cache flusher (or -1)
+ ** Output(s): 	 No output
+ ** Returns:	 Does not return
+ ** *******************************************************************************/
+void stopServer(int listenSocketFD, struct request** pending, int numPending, pid_t flusherPid)
+{
+	int i;
+	struct request* req;
+
+	close(listenSocketFD);
+	for (i = 0; i < numPending; i++)
+	{
+		close(pending[i]->fd);
+		free(pending[i]);
+	}
+	for (i = 0; i < NUM_CLASSES; i++)
+	{
+		while ((req = scheduler.head[i]) != NULL)
+		{
+			scheduler.head[i] = req->next;
+			close(req->fd);
+			free(req);
+		}
+	}
+
+	// the flusher only goes once no worker can post to the cache any more
+	pid_t done;
+	while (scheduler.active > 0 && (done = waitpid(-1, NULL, 0)) != -1)
+	{
+		if (done != flusherPid)
+		{
+			scheduler.active--;
+		}
+	}
+	if (flusherPid > 0)
+	{
+		kill(flusherPid, SIGTERM);
+		waitpid(flusherPid, NULL, 0);
+	}
+	exit(0);
+}
+
+
+/* ********************************************************************************** 
+ ** Description: Main loop of the otp_d parent process. It waits (with poll) for new
+		 connections, for headers to arrive on connections it has accepted,
+		 and for workers to finish. Requests are classified and queued as
+		 their headers arrive, and handed to workers whenever one is free.
+		 A connection that has not sent its header within HEADER_TIMEOUT is
+		 closed, so idle clients cannot use up the pending slots
+ ** Input(s): 	 The listening socket and the pid of the cache flusher (or -1)
+ ** Output(s): 	 Displays the queue wait report on stderr when sent SIGUSR1
+ ** Returns:	 Does not return - SIGTERM or SIGINT stops otp_d (see stopServer)
+ ** *******************************************************************************/
+void serveRequests(int listenSocketFD, pid_t flusherPid)
+{
+	struct request* pending[MAX_PENDING];	// connections whose headers are still arriving
+	struct pollfd fds[MAX_PENDING + 2];
+	int numPending = 0;
+	int i;
+
+	// workers, the report request and the stop request wake the loop up through the
+	// signal pipe
+	if (pipe2(scheduler.signalPipe, O_NONBLOCK | O_CLOEXEC) < 0) error("ERROR creating signal pipe");
+	struct sigaction SIGCHLD_action = {0};
+	SIGCHLD_action.sa_handler = catchSIGCHLD;
+	sigfillset(&SIGCHLD_action.sa_mask);
+	SIGCHLD_action.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+	sigaction(SIGCHLD, &SIGCHLD_action, NULL);
+	struct sigaction SIGUSR1_action = SIGCHLD_action;
+	SIGUSR1_action.sa_handler = catchSIGUSR1;
+	sigaction(SIGUSR1, &SIGUSR1_action, NULL);
+	struct sigaction SIGTERM_action = SIGCHLD_action;
+	SIGTERM_action.sa_handler = catchSIGTERM;
+	sigaction(SIGTERM, &SIGTERM_action, NULL);
+	sigaction(SIGINT, &SIGTERM_action, NULL);
+
+	fcntl(listenSocketFD, F_SETFL, O_NONBLOCK);
+
+	while(1)
+	{	
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+
+		// hand queued requests to any free workers
+		int timeout = -1;
+		struct request* req;
+		while (scheduler.active < scheduler.workers && (req = pickRequest(&now, &timeout)) != NULL)
+		{
+			dispatchRequest(req, listenSocketFD, pending, numPending);
+		}
+		if (scheduler.active >= scheduler.workers)
+		{
+			timeout = -1;	// nothing can go until a worker finishes
+		}
+
+		// wait for something to happen - new connections are only accepted while there
+		// is room to hold them
+		int numFds = 2;
+		fds[0].fd = scheduler.signalPipe[0];
+		fds[0].events = POLLIN;
+		fds[1].fd = numPending < MAX_PENDING ? listenSocketFD : -1;
+		fds[1].events = POLLIN;
+		if (numPending > 0)
+		{
+			// wake up in time to drop the oldest connection if its header is late
+			int millis = HEADER_TIMEOUT - (int)(elapsedMicros(&pending[0]->arrived, &now) / 1000);
+			if (millis < 0) millis = 0;
+			if (timeout < 0 || millis < timeout) timeout = millis;
+		}
+		for (i = 0; i < numPending; i++)
+		{
+			fds[numFds].fd = pending[i]->fd;
+			fds[numFds].events = POLLIN;
+			numFds++;
+		}
+		if (poll(fds, numFds, timeout) < 0)
+		{
+			if (errno == EINTR) continue;
+			error("ERROR on poll");
+		}
+		clock_gettime(CLOCK_MONOTONIC, &now);
+
+		// reap finished workers
+		if (fds[0].revents & POLLIN)
+		{
+			char drain[64];
+			while (read(scheduler.signalPipe[0], drain, sizeof(drain)) > 0);
+
+			pid_t done;
+			while ((done = waitpid(-1, NULL, WNOHANG)) > 0)
+			{
+				if (done != flusherPid && scheduler.active > 0)
+				{
+					scheduler.active--;
+				}
+			}
+
+			if (scheduler.reportWanted == 1)
+			{
+				char report[2048];
+				writeStats(report, sizeof(report));
+				fprintf(stderr, "%s", report);
+				scheduler.reportWanted = 0;
+			}
+
+			if (scheduler.stopWanted == 1)
+			{
+				stopServer(listenSocketFD, pending, numPending, flusherPid);
+			}
+		}
+
+		// read from connections whose headers are still arriving. Connections that are
+		// done with, or have taken too long to send their header, are dropped from the
+		// pending list, which is compacted as it goes
+		int kept = 0;
+		for (i = 0; i < numPending; i++)
+		{
+			req = pending[i];
+			if (fds[i + 2].revents != 0)
+			{
+				int charsRead = recv(req->fd, req->header + req->headerLength, HEADER_SIZE - req->headerLength, MSG_DONTWAIT);
+				if (charsRead < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+				{
+					close(req->fd);
+					free(req);
+					continue;
+				}
+				if (charsRead > 0)
+				{
+					req->headerLength += charsRead;
+				}
+
+				// the header is complete once the mode's '-' has arrived (or the client has
+				// stopped sending, or sent more than any valid header)
+				char* firstDash = memchr(req->header, '-', req->headerLength);
+				int complete = charsRead == 0 || req->headerLength == HEADER_SIZE ||
+					       (firstDash != NULL && memchr(firstDash + 1, '-', req->headerLength - (firstDash + 1 - req->header)) != NULL);
+				if (complete)
+				{
+					classifyRequest(req);
+					rateLimit(req, &now);
+					enqueueRequest(req);
+					continue;
+				}
+			}
+			if (elapsedMicros(&req->arrived, &now) >= HEADER_TIMEOUT * 1000.0)
+			{
+				close(req->fd);
+				free(req);
+				continue;
+			}
+			pending[kept++] = req;
+		}
+		numPending = kept;
+
+		// accept new connections
+		while (fds[1].fd >= 0 && (fds[1].revents & POLLIN) && numPending < MAX_PENDING)
+		{
+			struct sockaddr_in clientAddress;
+			socklen_t sizeOfClientInfo = sizeof(clientAddress);
+			int establishedConnectionFD = accept(listenSocketFD, (struct sockaddr *)&clientAddress, &sizeOfClientInfo); // Accept
+			if (establishedConnectionFD < 0)
+			{
+				if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED) error("ERROR on accept");
+				break;
+			}
+
+			req = malloc(sizeof(struct request));
+			memset(req, '\0', sizeof(struct request));
+			req->fd = establishedConnectionFD;
+			req->arrived = now;
+			inet_ntop(AF_INET, &clientAddress.sin_addr, req->key, sizeof(req->key));
+			req->local = (ntohl(clientAddress.sin_addr.s_addr) >> 24) == 127;
+			pending[numPending++] = req;
+		}
+	}
+}
+
+
+/* ********************************************************************************** 
+ ** Description: Main function. Upon execution, otp_d will listen on a particular
+		 port/socket, assigned when it is first ran as a command line argument.
+		 When a connection is made, otp_d accepts the connection and generates
+		 a new socket used for the actual communication, reads the request's
+		 header and queues it (see REQUEST SCHEDULING above). A forked child
+		 process handles the rest of the transaction, which will occur on the
+		 newly accepted socket. The original server daemon process will
+		 continue listening for new connections. By default it serves up to
+		 five requests at the same time. 
+		 If started with -c, recent posts are held in a shared in-memory
+		 tier (see above) before they are written to disk.
+		 Before listening, otp_d rebuilds its queue index from the user
+		 directories (see recoverDrops).
+ ** Input(s): 	 Command line argument representing a port number, optionally
+		 preceded by -c (per-user cache size in bytes) and -a (maximum age in
+		 seconds of a message held in memory), -r (number of threads used
+		 to scan user directories at startup), -w (number of requests served
+		 at once), -l (requests per second allowed for each user) and -b
+		 (burst size for the rate limit)
+ ** Output(s): 	 Displays error messages if there are any networking or connection
+		 issues or if an issue occurs when spawning a new child process
+ ** Returns: 	 Return value of 0
+ ** *******************************************************************************/
+
+int main(int argc, char *argv[])
+{	
+	int listenSocketFD, portNumber;
+	struct sockaddr_in serverAddress;
+
+	// Check usage and command line arguments
+	// -c bytes	keep recent posts in memory, with a ring of this many bytes per user
+	// -a seconds	write messages held in memory to disk once they are this old (default 30)
+	// -r threads	number of threads used to scan user directories at startup (default: one per CPU)
+	// -w workers	number of requests served at once (default 5)
+	// -l rate	limit each user to this many requests per second (default: no limit)
+	// -b burst	number of requests a rate limited user may make at once (default: the rate)
+	int cacheBudget = 0;
+	int cacheMaxAge = 30;
+	int recoveryThreads = sysconf(_SC_NPROCESSORS_ONLN);
+	int option;
+	scheduler.workers = 5;
+	while ((option = getopt(argc, argv, "c:a:r:w:l:b:")) != -1)
+	{
+		if (option == 'c') cacheBudget = atoi(optarg);
+		else if (option == 'a') cacheMaxAge = atoi(optarg);
+		else if (option == 'r') recoveryThreads = atoi(optarg);
+		else if (option == 'w') scheduler.workers = atoi(optarg);
+		else if (option == 'l') scheduler.rate = atof(optarg);
+		else if (option == 'b') scheduler.burst = atof(optarg);
+		else { fprintf(stderr,"USAGE: %s port [-c cachebytes] [-a maxage] [-r threads] [-w workers] [-l rate] [-b burst]\n", argv[0]); exit(1); }
+	}
+	if (optind >= argc) { fprintf(stderr,"USAGE: %s port [-c cachebytes] [-a maxage] [-r threads] [-w workers] [-l rate] [-b burst]\n", argv[0]); exit(1); }
+	if (scheduler.workers < 1) scheduler.workers = 1;
+	if (scheduler.burst < 1) scheduler.burst = scheduler.rate > 1 ? scheduler.rate : 1;
+
+	// rebuild the queue index from the user directories, cleaning up after any earlier otp_d
+	// that was stopped part way through a request. This is done before the socket is opened,
+	// so otp_d only accepts connections once it is ready to serve them
+	recoverDrops(recoveryThreads);
+
+	// Set up the address struct for this process (the server)
+	memset((char *)&serverAddress, '\0', sizeof(serverAddress)); 	// Clear out the address struct
+	portNumber = atoi(argv[optind]); 					// Get the port number, convert to an integer from a string
+	serverAddress.sin_family = AF_INET; 				// Create a network-capable socket
+	serverAddress.sin_port = htons(portNumber); 			// Store the port number
+	serverAddress.sin_addr.s_addr = INADDR_ANY; 			// Any address is allowed for connection to this process
+
+	// Create and set up the socket
+	listenSocketFD = socket(AF_INET, SOCK_STREAM, 0); 
+	if (listenSocketFD < 0) error("ERROR opening socket");
+
+	// Enable the socket to begin listening and connect socket to port
+	if (bind(listenSocketFD, (struct sockaddr *)&serverAddress, sizeof(serverAddress)) < 0)
+		error("ERROR on binding");
+	listen(listenSocketFD, 5); 					// Flip the socket on - it can now receive up to 5 connections
+
+	// set up the hot message tier if it was requested, along with the child process that
+	// writes out messages which have been held in memory for too long
+	pid_t flusherPid = -1;
+	if (cacheBudget > 0)
+	{
+		if (cacheBudget > MAX_SIZE - 1) cacheBudget = MAX_SIZE - 1;
+		cacheInit(cacheBudget, cacheMaxAge);
+
+		pid_t parentPid = getpid();
+		flusherPid = fork();
+		if (flusherPid == -1)
+		{
+			perror("Error spawning cache flusher\n");
+		}
+		else if (flusherPid == 0)
+		{
+			close(listenSocketFD);
+			cacheFlusher(parentPid);
+		}
+	}
+
+	// hand requests to workers until otp_d is stopped
+	serveRequests(listenSocketFD, flusherPid);
+
+	close(listenSocketFD);
+	return 0;
+}